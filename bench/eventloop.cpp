@@ -0,0 +1,98 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+#include "event_loop.h"
+
+#ifdef PROMISE_THREADS
+#include <atomic>
+#include <thread>
+#include "atomic_suspension_point.h"
+#endif
+
+using namespace promise;
+
+namespace {
+
+Promise<void> wait_forever(SuspensionPoint<void>& point, long long& wakeups) {
+    for (;;) {
+        co_await point;
+        wakeups++;
+    }
+}
+
+Promise<int> ready(int i) { co_return i; }
+
+Promise<void> await_ready(long long n, long long& sum) {
+    for (long long i = 0; i < n; i++) sum += co_await ready(int(i));
+}
+
+#ifdef PROMISE_THREADS
+Promise<void> wait_forever_atomic(AtomicSuspensionPoint<void>& point, long long& wakeups) {
+    for (;;) {
+        co_await point;
+        wakeups++;
+    }
+}
+#endif
+
+}  // namespace
+
+// SuspensionPoint::resume() posting to the loop and the loop running the resumption, for the given number of waiters
+static void posted_resume(benchmark::State& state) {
+    EventLoop loop;
+    std::vector<SuspensionPoint<void>> points(state.range(0));
+    long long wakeups = 0;
+    for (auto& point : points) loop.spawn(wait_forever(point, wakeups));
+    loop.run();
+    for (auto _ : state) {
+        for (auto& point : points) point.resume();
+        loop.run_once();
+    }
+    benchmark::DoNotOptimize(wakeups);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(posted_resume)->Arg(1)->Arg(64)->Arg(4096);
+
+// Awaits of coroutines that finish right away inside the loop, with the given budget (0 disables time slicing)
+static void sliced_ready_await(benchmark::State& state) {
+    constexpr long long n = 4096;
+    long long sum = 0;
+    for (auto _ : state) {
+        EventLoop loop;
+        loop.set_budget(state.range(0));
+        loop.spawn(await_ready(n, sum));
+        loop.run();
+    }
+    benchmark::DoNotOptimize(sum);
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(sliced_ready_await)->Arg(0)->Arg(16)->Arg(128);
+
+#ifdef PROMISE_THREADS
+// Round trip of another thread resuming a coroutine of the loop, including waking the loop when it sleeps
+static void remote_handoff(benchmark::State& state) {
+    EventLoop loop;
+    AtomicSuspensionPoint<void> point;
+    long long wakeups = 0;
+    loop.spawn(wait_forever_atomic(point, wakeups));
+    loop.run();
+    std::atomic<long long> requested = 0;
+    std::atomic<bool> stop = false;
+    std::thread poster([&] {
+        for (long long resumed = 0; !stop.load(std::memory_order_acquire);) {
+            if (requested.load(std::memory_order_acquire) > resumed) {
+                point.resume();
+                resumed++;
+            }
+        }
+    });
+    for (auto _ : state) {
+        long long target = wakeups + 1;
+        requested.fetch_add(1, std::memory_order_release);
+        loop.run_until([&] { return wakeups == target; });
+    }
+    stop.store(true, std::memory_order_release);
+    poster.join();
+}
+BENCHMARK(remote_handoff)->UseRealTime();
+#endif
@@ -0,0 +1,142 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+#include "functionhook.h"
+#include "hook.h"
+
+using namespace promise;
+
+namespace {
+
+struct Payload {
+    inline static int64_t copies = 0;
+    std::string data = std::string(1024, 'x');
+    Payload() = default;
+    Payload(const Payload& other) : data(other.data) { copies++; }
+    Payload(Payload&&) = default;
+};
+
+class Hooked {
+   public:
+    int calls = 0;
+    HOOK(int, void, Hooked, async_add, int, int);
+    NON_BLOCKING_HOOK(int, Hooked, add, int, int);
+    NON_BLOCKING_HOOK(void, Hooked, consume, Payload);
+    HOOK(void, void, Hooked, async_consume, Payload);
+};
+
+Promise<int> Hooked::async_add::impl(int a, int b) {
+    self->calls++;
+    co_return a + b;
+}
+
+int Hooked::add::impl(int a, int b) {
+    self->calls++;
+    return a + b;
+}
+
+void Hooked::consume::impl(Payload payload) { benchmark::DoNotOptimize(payload.data.data()); }
+
+Promise<void> Hooked::async_consume::impl(Payload payload) {
+    benchmark::DoNotOptimize(payload.data.data());
+    co_return;
+}
+
+Promise<void> empty_hook(const int&, const int&) { co_return; }
+
+}  // namespace
+
+// Observable promise dispatch with the given number of pre and post hooks each
+static void hook_dispatch(benchmark::State& state) {
+    Hooked hooked;
+    for (int i = 0; i < state.range(0); i++) {
+        hooked.async_add.preHooks += empty_hook;
+        hooked.async_add.postHooks += [](int, int) -> Promise<void> { co_return; };
+    }
+    for (auto _ : state) {
+        auto p = hooked.async_add(1, 2);
+        p->start();
+        benchmark::DoNotOptimize(p->returned_value());
+    }
+}
+BENCHMARK(hook_dispatch)->Arg(0)->Arg(1)->Arg(8);
+
+// hook_dispatch with the impl behind a std::function instead of the statically bound impl of HOOK
+static void hook_runtime_impl(benchmark::State& state) {
+    int calls = 0;
+    ObservablePromise<int, void, int, int> async_add([&calls](int a, int b) -> Promise<int> {
+        calls++;
+        co_return a + b;
+    });
+    for (int i = 0; i < state.range(0); i++) {
+        async_add.preHooks += empty_hook;
+        async_add.postHooks += [](int, int) -> Promise<void> { co_return; };
+    }
+    for (auto _ : state) {
+        auto p = async_add(1, 2);
+        p->start();
+        benchmark::DoNotOptimize(p->returned_value());
+    }
+    benchmark::DoNotOptimize(calls);
+}
+BENCHMARK(hook_runtime_impl)->Arg(0)->Arg(1)->Arg(8);
+
+static void non_blocking_hook_dispatch(benchmark::State& state) {
+    Hooked hooked;
+    int seen = 0;
+    for (int i = 0; i < state.range(0); i++) {
+        hooked.add.preHooks += [&seen](int a, int) { seen += a; };
+        hooked.add.postHooks += [&seen](int r, int, int) { seen += r; };
+    }
+    int x = 0;
+    for (auto _ : state) benchmark::DoNotOptimize(x = hooked.add(x, 1));
+    benchmark::DoNotOptimize(seen);
+}
+BENCHMARK(non_blocking_hook_dispatch)->Arg(0)->Arg(1)->Arg(8);
+
+// Same impl behind a std::function instead of the statically bound impl of NON_BLOCKING_HOOK
+static void non_blocking_runtime_impl(benchmark::State& state) {
+    int calls = 0;
+    ObservableFunction<int, int, int> add([&calls](int a, int b) {
+        calls++;
+        return a + b;
+    });
+    int x = 0;
+    for (auto _ : state) benchmark::DoNotOptimize(x = add(x, 1));
+    benchmark::DoNotOptimize(calls);
+}
+BENCHMARK(non_blocking_runtime_impl);
+
+// Cost of passing a 1 KiB argument through the hooks, with and without post hooks that keep it alive. The copies
+// counter gives the copies of the argument per call.
+static void argument_passing(benchmark::State& state) {
+    Hooked hooked;
+    for (int i = 0; i < 8; i++) hooked.consume.preHooks += [](const Payload& p) { benchmark::DoNotOptimize(&p); };
+    if (state.range(0)) hooked.consume.postHooks += [](const Payload& p) { benchmark::DoNotOptimize(&p); };
+    Payload::copies = 0;
+    for (auto _ : state) hooked.consume(Payload{});
+    state.counters["copies"] = benchmark::Counter((double) Payload::copies, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(argument_passing)->Arg(0)->Arg(1);
+
+// The same for HOOK, whose impl and hooks are promises
+static void async_argument_passing(benchmark::State& state) {
+    Hooked hooked;
+    for (int i = 0; i < 8; i++) {
+        hooked.async_consume.preHooks += [](const Payload& p) -> Promise<void> {
+            benchmark::DoNotOptimize(&p);
+            co_return;
+        };
+    }
+    if (state.range(0)) {
+        hooked.async_consume.postHooks += [](const Payload& p) -> Promise<void> {
+            benchmark::DoNotOptimize(&p);
+            co_return;
+        };
+    }
+    Payload::copies = 0;
+    for (auto _ : state) hooked.async_consume(Payload{})->start();
+    state.counters["copies"] = benchmark::Counter((double) Payload::copies, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(async_argument_passing)->Arg(0)->Arg(1);
@@ -0,0 +1,16 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+// Reports JSON by default so results can be compared between releases, --benchmark_format=console overrides it.
+int main(int argc, char** argv) {
+    char json[] = "--benchmark_format=json";
+    std::vector<char*> args(argv, argv + argc);
+    args.insert(args.begin() + 1, json);
+    int count = (int) args.size();
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "mapped_file.h"
+
+using namespace promise;
+
+namespace {
+
+constexpr long long line_count = 100000;
+
+const std::string& lines_file() {
+    static std::string path = [] {
+        std::string path = (std::filesystem::temp_directory_path() / "promise_bench_lines.txt").string();
+        std::ofstream file(path, std::ios::binary);
+        for (long long i = 0; i < line_count; i++) file << "line " << i << " with some padding to look like a log\n";
+        return path;
+    }();
+    return path;
+}
+
+}  // namespace
+
+// Lines yielded as views into the mapping, the generator is driven by hand
+static void mapped_lines(benchmark::State& state) {
+    size_t bytes = 0;
+    for (auto _ : state) {
+        auto generator = io::mapped_lines(lines_file());
+        for (generator->start(); !generator->done(); generator->resume()) bytes += generator->yielded_value()->size();
+    }
+    benchmark::DoNotOptimize(bytes);
+    state.SetItemsProcessed(state.iterations() * line_count);
+}
+BENCHMARK(mapped_lines);
+
+// The same lines copied out of an ifstream with std::getline, for comparison
+static void getline_lines(benchmark::State& state) {
+    size_t bytes = 0;
+    for (auto _ : state) {
+        std::ifstream file(lines_file(), std::ios::binary);
+        for (std::string line; std::getline(file, line);) bytes += line.size();
+    }
+    benchmark::DoNotOptimize(bytes);
+    state.SetItemsProcessed(state.iterations() * line_count);
+}
+BENCHMARK(getline_lines);
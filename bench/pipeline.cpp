@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+
+#include "pipeline.h"
+
+using namespace promise;
+
+namespace {
+
+constexpr int element_count = 10000;
+
+Promise<void, int> numbers(int n) {
+    for (int i = 0; i < n; i++) co_yield i;
+}
+
+// The same stages written by hand as one generator per stage
+Promise<void, int> squared(Promise<void, int> source) {
+    while (auto value = co_await pull(source)) co_yield *value * *value;
+}
+Promise<void, int> even(Promise<void, int> source) {
+    while (auto value = co_await pull(source))
+        if (*value % 2 == 0) co_yield *value;
+}
+Promise<void, int> first(Promise<void, int> source, int n) {
+    for (int i = 0; i < n; i++) {
+        auto value = co_await pull(source);
+        if (!value) break;
+        co_yield *value;
+    }
+}
+
+long long drain(Promise<void, int> generator) {
+    long long sum = 0;
+    for (generator->start(); !generator->done(); generator->resume()) sum += *generator->yielded_value();
+    return sum;
+}
+
+}  // namespace
+
+// transform | filter | take inside the co_yield of the source, an element only resumes the frame of the source
+static void fused_pipeline(benchmark::State& state) {
+    long long sum = 0;
+    for (auto _ : state) {
+        Promise<void, int> p = numbers(element_count) | transform([](int x) { return x * x; }) |
+                               filter([](int x) { return x % 2 == 0; }) | take(element_count);
+        sum += drain(std::move(p));
+    }
+    benchmark::DoNotOptimize(sum);
+    state.SetItemsProcessed(state.iterations() * element_count);
+}
+BENCHMARK(fused_pipeline);
+
+// The same stages as nested generators, every element crosses a resumption per stage
+static void nested_pipeline(benchmark::State& state) {
+    long long sum = 0;
+    for (auto _ : state) sum += drain(first(even(squared(numbers(element_count))), element_count));
+    benchmark::DoNotOptimize(sum);
+    state.SetItemsProcessed(state.iterations() * element_count);
+}
+BENCHMARK(nested_pipeline);
@@ -0,0 +1,111 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+#include "promise.h"
+
+using namespace promise;
+
+namespace {
+
+Promise<void> empty_co() { co_return; }
+
+Promise<int> returning(int x) { co_return x; }
+
+Promise<int> nested(int depth) {
+    if (!depth) co_return 0;
+    co_return co_await nested(depth - 1) + 1;
+}
+
+Promise<void, int> yield_range(int max) {
+    for (int i = 0; i < max; i++) co_yield i;
+}
+
+Promise<void, int> nested_yield(int depth, int max) {
+    if (!depth) {
+        co_await yield_range(max);
+    } else {
+        co_await nested_yield(depth - 1, max);
+    }
+}
+
+Promise<void> await_points(std::vector<SuspensionPoint<void>>& points) { co_await points; }
+
+Promise<void> await_promises(std::vector<Promise<int>>& promises) { co_await promises; }
+
+}  // namespace
+
+static void create_destroy(benchmark::State& state) {
+    for (auto _ : state) {
+        auto p = empty_co();
+        benchmark::DoNotOptimize(p);
+    }
+}
+BENCHMARK(create_destroy);
+
+static void create_start_destroy(benchmark::State& state) {
+    for (auto _ : state) {
+        auto p = returning(1);
+        p->start();
+        benchmark::DoNotOptimize(p->returned_value());
+    }
+}
+BENCHMARK(create_start_destroy);
+
+// co_await chain of the given depth, every level is a separate coroutine
+static void await_depth(benchmark::State& state) {
+    int depth = (int) state.range(0);
+    for (auto _ : state) {
+        auto p = nested(depth);
+        p->start();
+        benchmark::DoNotOptimize(p->returned_value());
+    }
+    state.SetItemsProcessed(state.iterations() * (depth + 1));
+}
+BENCHMARK(await_depth)->RangeMultiplier(4)->Range(1, 256);
+
+static void yield_flat(benchmark::State& state) {
+    int count = (int) state.range(0);
+    for (auto _ : state) {
+        auto p = yield_range(count);
+        for (p->start(); !p->done(); p->resume()) benchmark::DoNotOptimize(p->yielded_value());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(yield_flat)->Arg(1024);
+
+// Every yield is propagated through the given number of callers
+static void yield_nested(benchmark::State& state) {
+    int depth = (int) state.range(0);
+    constexpr int count = 1024;
+    for (auto _ : state) {
+        auto p = nested_yield(depth, count);
+        for (p->start(); !p->done(); p->resume()) benchmark::DoNotOptimize(p->yielded_value());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(yield_nested)->RangeMultiplier(4)->Range(1, 64);
+
+static void range_await_points(benchmark::State& state) {
+    std::vector<SuspensionPoint<void>> points(state.range(0));
+    for (auto _ : state) {
+        auto p = await_points(points);
+        p->start();
+        for (auto& point : points) point.resume();
+        benchmark::DoNotOptimize(p->done());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(range_await_points)->RangeMultiplier(4)->Range(1, 256);
+
+static void range_await_promises(benchmark::State& state) {
+    for (auto _ : state) {
+        std::vector<Promise<int>> promises;
+        promises.reserve(state.range(0));
+        for (int i = 0; i < state.range(0); i++) promises.push_back(returning(i));
+        auto p = await_promises(promises);
+        p->start();
+        benchmark::DoNotOptimize(p->done());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(range_await_promises)->RangeMultiplier(4)->Range(1, 256);
@@ -0,0 +1,32 @@
+#include <benchmark/benchmark.h>
+
+// Shards are threads, they only build with PROMISE_THREADS
+#ifdef PROMISE_THREADS
+#include <future>
+#include "shard.h"
+
+using namespace promise;
+
+namespace {
+
+Promise<void> call_repeatedly(size_t target, long long n, std::promise<void>& done) {
+    for (long long i = 0; i < n; i++) co_await shard(target).invoke([] { return this_shard().id(); });
+    done.set_value();
+}
+
+}  // namespace
+
+// Round trips of co_await shard(n).invoke() from shard 0, to itself (0) and to another shard (1)
+static void shard_invoke(benchmark::State& state) {
+    constexpr long long n = 1000;
+    ShardRuntime runtime(2);
+    for (auto _ : state) {
+        std::promise<void> done;
+        runtime.submit(0, [&] { this_shard().spawn(call_repeatedly(state.range(0), n, done)); });
+        done.get_future().wait();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(shard_invoke)->Arg(0)->Arg(1)->UseRealTime();
+
+#endif
@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+
+#include "atomic_suspension_point.h"
+#include "promise.h"
+
+using namespace promise;
+
+namespace {
+
+Promise<void> wait_forever(SuspensionPoint<void>& point, long long& wakeups) {
+    for (;;) {
+        co_await point;
+        wakeups++;
+    }
+}
+
+Promise<void> wait_nested(SuspensionPoint<void>& point, long long& wakeups, int depth) {
+    if (!depth) {
+        co_await wait_forever(point, wakeups);
+    } else {
+        co_await wait_nested(point, wakeups, depth - 1);
+    }
+}
+
+Promise<void, int> receive_forever(SuspensionPoint<int>& point) {
+    for (;;) co_yield co_await point;
+}
+
+Promise<void> wait_forever_atomic(AtomicSuspensionPoint<void>& point, long long& wakeups) {
+    for (;;) {
+        co_await point;
+        wakeups++;
+    }
+}
+
+}  // namespace
+
+// Time from resume() until the waiting coroutine is suspended again, for waiters nested at the given depth
+static void resume_latency(benchmark::State& state) {
+    SuspensionPoint<void> point;
+    long long wakeups = 0;
+    auto p = wait_nested(point, wakeups, (int) state.range(0));
+    p->start();
+    for (auto _ : state) point.resume();
+    benchmark::DoNotOptimize(wakeups);
+}
+BENCHMARK(resume_latency)->Arg(0)->Arg(1)->Arg(8)->Arg(64);
+
+// A value passed through resume() and yielded back. The receiver is parked at its co_yield afterwards, resuming it
+// moves it back to the point for the next round.
+static void resume_with_value(benchmark::State& state) {
+    SuspensionPoint<int> point;
+    auto p = receive_forever(point);
+    p->start();
+    int i = 0;
+    long long sum = 0;
+    for (auto _ : state) {
+        point.resume(i++);
+        sum += *p->yielded_value();
+        p->resume();
+    }
+    benchmark::DoNotOptimize(sum);
+}
+BENCHMARK(resume_with_value);
+
+// resume_latency/0 with the state machine of the thread safe point
+static void atomic_resume_latency(benchmark::State& state) {
+    AtomicSuspensionPoint<void> point;
+    long long wakeups = 0;
+    auto p = wait_forever_atomic(point, wakeups);
+    p->start();
+    for (auto _ : state) point.resume();
+    benchmark::DoNotOptimize(wakeups);
+}
+BENCHMARK(atomic_resume_latency);
@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "promise.h"
+
+namespace promise {
+
+// SuspensionPoint that can be resumed from any thread, also while the waiter is still suspending or before it awaits.
+// The waiter is resumed on the executor of its chain, or inline on the notifying thread if it has none.
+// One waiter and one resume() per round: after the waiter took the value the point can be awaited again.
+template <typename T> class AtomicSuspensionPoint final : public detail::DeferredWait {
+   public:
+    AtomicSuspensionPoint() = default;
+    AtomicSuspensionPoint(const AtomicSuspensionPoint&) = delete;
+
+    template <typename... V> void resume(V&&... v) {
+        if constexpr (std::is_void_v<T>) {
+            static_assert(sizeof...(V) == 0);
+            m_value.set();
+        } else {
+            m_value = T(std::forward<V>(v)...);
+        }
+        State previous = m_state.exchange(notified, std::memory_order_acq_rel);
+        assert(previous != notified);
+        if (previous == waiting) wake();
+    }
+    bool notified_before() const noexcept { return m_state.load(std::memory_order_acquire) == notified; }
+
+    struct Awaiter {
+        AtomicSuspensionPoint& point;
+        bool await_ready() const noexcept { return point.notified_before(); }
+        void await_suspend(auto caller_handle) { point.suspend(caller_handle.promise(), &point); }
+        T await_resume() { return point.take(); }
+    };
+
+    // Publishes the waiter, unless resume() came first. Then exactly one of both wakes it.
+    void root_suspended(Coroutine&) override {
+        State expected = empty;
+        if (!m_state.compare_exchange_strong(expected, waiting, std::memory_order_acq_rel)) wake();
+    }
+
+   private:
+    using State = uint8_t;
+    static constexpr State empty = 0, waiting = 1, notified = 2;
+
+    void wake() {
+        assert(m_handle);
+        auto handle = *m_handle;
+        m_handle.reset();
+        trace::woken(handle.operator->(), this);
+        if (auto executor = handle->executor()) {
+            executor->post(handle, m_priority);
+        } else {
+            handle->resume();
+        }
+    }
+    // Empty again only after the value is gone, the next resume() may come right after
+    T take() {
+        assert(m_value);
+        if constexpr (std::is_void_v<T>) {
+            m_value.reset();
+            m_state.store(empty, std::memory_order_release);
+        } else {
+            T value = std::move(*m_value);
+            m_value.reset();
+            m_state.store(empty, std::memory_order_release);
+            return value;
+        }
+    }
+
+    std::atomic<State> m_state = empty;
+    optional<T> m_value;
+};
+
+template <typename T> auto Coroutine::await_transform(AtomicSuspensionPoint<T>& s) {
+    return typename AtomicSuspensionPoint<T>::Awaiter{s};
+}
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::AtomicSuspensionPoint;
+#endif
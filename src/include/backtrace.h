@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <unordered_set>
+#include <vector>
+
+#include "promise.h"
+
+// Async backtraces of all live coroutines. Needs Coroutine::living, so define PROMISE_LIVE_REGISTRY (in every
+// translation unit) to use it outside of tests.
+// Walking reads the coroutines without synchronisation, so call it while no other thread resumes them.
+namespace promise::backtrace {
+
+enum class State { created, running, awaiting, waiting, yielded, done };
+
+inline const char* to_string(State state) {
+    switch (state) {
+        case State::created:
+            return "created";
+        case State::running:
+            return "running";
+        case State::awaiting:
+            return "awaiting";
+        case State::waiting:
+            return "waiting";
+        case State::yielded:
+            return "yielded";
+        case State::done:
+            return "done";
+    }
+    return "";
+}
+
+struct Frame {
+    const Coroutine* coroutine;
+    const char* function;
+    size_t depth;
+    State state;
+    std::chrono::steady_clock::duration suspended_for{};  // Zero unless the coroutine is suspended
+    const void* waiting_on = nullptr;                      // The suspension point the chain is waiting on
+};
+
+// Innermost coroutine first at depth 0, each one is awaited by the next.
+using Chain = std::vector<Frame>;
+
+#ifdef PROMISE_TRACK_LIVING
+namespace detail {
+
+struct Access {
+    static const Coroutine* callee(const Coroutine& c) {
+        return c.m_calling;
+    }
+    static Frame frame(const Coroutine& c, std::chrono::steady_clock::time_point now) {
+        Frame f{&c, c.m_function, 0, state(c)};
+        if (f.state != State::created && f.state != State::running && f.state != State::done) {
+            f.suspended_for = now - c.m_suspended_at;
+        }
+        f.waiting_on = c.m_wait_object;
+        return f;
+    }
+    static State state(const Coroutine& c) {
+        if (!c.started()) return State::created;
+        if (c.done()) return State::done;
+        if (c.m_calling) return State::awaiting;
+        if (c.m_wait_object) return State::waiting;
+        if (c.yielded()) return State::yielded;
+        return State::running;
+    }
+};
+
+}  // namespace detail
+
+inline std::vector<Chain> chains() {
+    std::vector<const Coroutine*> all;
+    std::unordered_set<const Coroutine*> callees;
+    Coroutine::living.for_each([&](const Coroutine& c) {
+        all.push_back(&c);
+        if (auto callee = detail::Access::callee(c)) callees.insert(callee);
+    });
+    auto now = std::chrono::steady_clock::now();
+    std::vector<Chain> result;
+    for (auto root : all) {
+        if (callees.count(root)) continue;
+        Chain& chain = result.emplace_back();
+        for (auto c = root; c; c = detail::Access::callee(*c)) chain.push_back(detail::Access::frame(*c, now));
+        std::reverse(chain.begin(), chain.end());
+        for (size_t depth = 0; depth < chain.size(); depth++) chain[depth].depth = depth;
+    }
+    return result;
+}
+
+// Writes one backtrace per chain, the innermost coroutine first like a stack trace.
+inline void dump(std::ostream& out) {
+    auto all = chains();
+    for (size_t i = 0; i < all.size(); i++) {
+        auto& chain = all[i];
+        out << "chain " << i << ": " << to_string(chain.front().state);
+        if (chain.front().waiting_on) out << " on " << chain.front().waiting_on;
+        out << "\n";
+        for (auto f = chain.begin(); f != chain.end(); f++) {
+            out << "  #" << f->depth << " " << (f->function ? f->function : "?") << " [" << to_string(f->state);
+            if (f->suspended_for.count()) {
+                out << " " << std::chrono::duration_cast<std::chrono::microseconds>(f->suspended_for).count() << "us";
+            }
+            out << "]\n";
+        }
+    }
+}
+#endif
+
+}  // namespace promise::backtrace
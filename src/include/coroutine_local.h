@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Coroutine local storage: values like trace ids or deadlines that every coroutine of an await chain sees without
+// passing them along. Awaited coroutines see the slots of their caller through a plain pointer. A coroutine that sets a
+// value takes a copy of the slots first, so the value is only seen by it and the coroutines it awaits. Coroutines that
+// run on their own, like the children of a TaskGroup, start with a copy.
+
+namespace promise {
+
+template <typename T> class Local;
+
+namespace detail {
+
+inline uint32_t next_local_index() noexcept {
+    static std::atomic<uint32_t> count{};
+    return count.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Slots indexed by the index of their key, a lookup is a bounds check and a load. Copies clone the values.
+class Locals {
+   public:
+    Locals() = default;
+    Locals(const Locals& other) { *this = other; }
+    Locals& operator=(const Locals& other) {
+        m_slots.clear();
+        m_slots.reserve(other.m_slots.size());
+        for (auto& slot : other.m_slots) m_slots.push_back(slot ? slot->clone() : nullptr);
+        return *this;
+    }
+    template <typename T> T* get(uint32_t index) const noexcept {
+        if (index >= m_slots.size() || !m_slots[index]) return nullptr;
+        return &static_cast<Slot<T>*>(m_slots[index].get())->value;
+    }
+    template <typename T> T& set(uint32_t index, T value) {
+        if (index >= m_slots.size()) m_slots.resize(index + 1);
+        // Assigned in place, pointers to the value stay valid
+        if (m_slots[index]) return static_cast<Slot<T>*>(m_slots[index].get())->value = std::move(value);
+        m_slots[index] = std::make_unique<Slot<T>>(std::move(value));
+        return static_cast<Slot<T>*>(m_slots[index].get())->value;
+    }
+
+   private:
+    struct SlotBase {
+        virtual ~SlotBase() = default;
+        virtual std::unique_ptr<SlotBase> clone() const = 0;
+    };
+    template <typename T> struct Slot : SlotBase {
+        explicit Slot(T v) : value(std::move(v)) {}
+        std::unique_ptr<SlotBase> clone() const override { return std::make_unique<Slot>(value); }
+        T value;
+    };
+    std::vector<std::unique_ptr<SlotBase>> m_slots;
+};
+
+template <typename T> struct LocalSet {
+    const Local<T>& key;
+    T value;
+};
+
+}  // namespace detail
+
+// Key of a coroutine local value of type T. Every key takes a slot index for the lifetime of the program, so define
+// them once, like globals.
+// Inside a coroutine, co_await key gives a T* (nullptr if it is not set) and co_await key.set(value) gives a T&.
+template <typename T> class Local {
+    static_assert(std::is_copy_constructible_v<T> && std::is_move_assignable_v<T>,
+                  "Coroutine local values are copied into the coroutines that set their own");
+
+   public:
+    Local() noexcept : m_index(detail::next_local_index()) {}
+    Local(const Local&) = delete;
+
+    detail::LocalSet<T> set(T value) const { return {*this, std::move(value)}; }
+    uint32_t index() const noexcept { return m_index; }
+
+   private:
+    uint32_t m_index;
+};
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::Local;
+#endif
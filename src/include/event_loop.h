@@ -0,0 +1,280 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <utility>
+
+#include "promise.h"
+
+#if defined(PROMISE_THREADS) && defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+#endif
+
+namespace promise {
+
+#ifdef PROMISE_THREADS
+namespace detail {
+
+// Intrusive lock-free queue of resumptions that many threads post and one thread drains. Producers push onto a
+// stack, the consumer takes all of it at once and reverses it into posting order. A queued coroutine keeps a
+// reference, the link lives in the coroutine because the root of a chain is posted at most once per suspension.
+class RemoteQueue {
+   public:
+    RemoteQueue() = default;
+    RemoteQueue(const RemoteQueue&) = delete;
+    ~RemoteQueue() {
+        drain([](Coroutine::Handle, Priority) {});
+    }
+
+    // Returns true if the queue was empty before.
+    bool push(Coroutine& coroutine, Priority priority) {
+        coroutine.gain_ref();
+        coroutine.m_remote_priority = priority;
+        Coroutine* head = m_head.load(std::memory_order_relaxed);
+        do {
+            coroutine.m_remote_next = head;
+        } while (!m_head.compare_exchange_weak(head, &coroutine, std::memory_order_seq_cst,
+                                               std::memory_order_relaxed));
+        return !head;
+    }
+    // Consumer only, passes each queued handle with its priority to f, oldest first.
+    template <typename F> size_t drain(F&& f) {
+        Coroutine* head = m_head.exchange(nullptr, std::memory_order_acquire);
+        Coroutine* oldest = nullptr;
+        while (head) {
+            Coroutine* next = std::exchange(head->m_remote_next, oldest);
+            oldest = std::exchange(head, next);
+        }
+        size_t count = 0;
+        while (oldest) {
+            Coroutine& coroutine = *oldest;
+            oldest = std::exchange(coroutine.m_remote_next, nullptr);
+            Coroutine::Handle handle(coroutine);
+            coroutine.lose_ref();  // The reference of the queue moved to handle
+            f(handle, coroutine.m_remote_priority);
+            count++;
+        }
+        return count;
+    }
+    bool empty() const noexcept { return !m_head.load(std::memory_order_seq_cst); }
+
+   private:
+    std::atomic<Coroutine*> m_head{};
+};
+
+}  // namespace detail
+#endif
+
+// Single threaded run loop. Coroutines bound to it are not resumed inside SuspensionPoint::resume(), the resumption
+// is queued and runs in the next batch of run_once(). This keeps the stack of the notifier flat and serves the
+// waiting coroutines in FIFO order.
+// There is one queue per priority and a batch runs the highest priority that has work. A lower priority that was passed
+// over starvation_limit times while it had work gets the next batch, so background work keeps making progress.
+// A resumption may await budget coroutines that finish without suspending, the next await yields and queues the
+// coroutine at the back again. This keeps one hot coroutine from starving the others.
+// With PROMISE_THREADS other threads may post too. Their resumptions go through a lock-free queue that the next batch
+// drains at once, a loop that sleeps in wait() is woken through an eventfd. The loop belongs to the thread that
+// constructed it or last ran it.
+class EventLoop : public Executor {
+   public:
+    explicit EventLoop(size_t starvation_limit = 16, size_t budget = 128)
+        : m_starvation_limit(starvation_limit), m_budget(budget) {
+#if defined(PROMISE_THREADS) && defined(__linux__)
+        m_wake_fd = eventfd(0, EFD_CLOEXEC);
+        if (m_wake_fd < 0) throw std::system_error(errno, std::generic_category(), "eventfd");
+#endif
+    }
+    EventLoop(const EventLoop&) = delete;
+#if defined(PROMISE_THREADS) && defined(__linux__)
+    ~EventLoop() { close(m_wake_fd); }
+#endif
+
+    void post(Coroutine::Handle handle, Priority priority) override {
+#ifdef PROMISE_THREADS
+        if (std::this_thread::get_id() != m_owner.load(std::memory_order_relaxed)) {
+            m_remote.push(*handle.operator->(), priority);
+            wake();
+            return;
+        }
+#endif
+        m_ready[level(priority)].push_back(handle);
+        m_peak_size = std::max(m_peak_size, size());
+    }
+    bool spend_budget() noexcept override {
+        if (!m_running || !m_budget) return false;
+        if (m_budget_left) m_budget_left--;
+        return !m_budget_left;
+    }
+    bool yield(Coroutine& coroutine) noexcept override {
+        if (!m_running) return false;
+        m_yields++;
+        m_requeue.arm(coroutine);
+        return true;
+    }
+    // Zero disables time slicing, co_await yield_now() still yields.
+    void set_budget(size_t budget) noexcept { m_budget = budget; }
+    // Binds the promise to the loop and queues its start. The loop keeps it alive until it first suspends.
+    template <typename R, typename Y> void spawn(Promise<R, Y>& promise) {
+        promise->set_executor(this);
+        post(promise, promise->priority());
+    }
+    template <typename R, typename Y> void spawn(Promise<R, Y>&& promise) { spawn(promise); }
+    template <typename R, typename Y> void spawn(Promise<R, Y>& promise, Priority priority) {
+        promise->set_priority(priority);
+        spawn(promise);
+    }
+    template <typename R, typename Y> void spawn(Promise<R, Y>&& promise, Priority priority) {
+        spawn(promise, priority);
+    }
+
+    // Runs the queued resumptions of one priority, the ones they post wait for the next batch.
+    size_t run_once() {
+        assert(!m_running);
+#ifdef PROMISE_THREADS
+        m_owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        m_remote.drain(
+            [&](Coroutine::Handle& handle, Priority priority) { m_ready[level(priority)].push_back(handle); });
+#endif
+        size_t next = pick();
+        if (next == priority_count) return 0;
+        for (size_t i = next + 1; i < priority_count; i++) {
+            if (!m_ready[i].empty()) m_passed[i]++;
+        }
+        m_passed[next] = 0;
+        m_running = true;
+        auto& ready = m_ready[next];
+        size_t count = ready.size();
+        for (size_t i = 0; i < count; i++) {
+            Coroutine::Handle handle = ready.front();
+            ready.pop_front();
+            run(handle);
+        }
+        m_running = false;
+        m_resumed += count;
+        m_batches++;
+        return count;
+    }
+    // Runs batches until nothing is queued anymore.
+    size_t run() {
+        size_t total = 0;
+        while (size_t count = run_once()) total += count;
+        return total;
+    }
+#ifdef PROMISE_THREADS
+    // Blocks until another thread posts, unless something is queued already. May return early.
+    void wait() {
+        if (size()) return;
+        // Either the poster sees the flag and wakes the loop, or the loop sees what it pushed
+        m_sleeping.store(true);
+        if (m_remote.empty()) {
+#ifdef __linux__
+            uint64_t count;
+            while (read(m_wake_fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+            }
+#else
+            m_sleeping.wait(true);
+#endif
+        }
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+    // Runs and waits for posts of other threads until done() returns true.
+    template <typename Done> size_t run_until(Done done) {
+        size_t total = 0;
+        while (!done()) {
+            if (size_t count = run()) {
+                total += count;
+            } else {
+                wait();
+            }
+        }
+        return total;
+    }
+    // For a thread that sleeps elsewhere than in wait(): wake is called instead of the eventfd after other threads
+    // posted. Set it before they post.
+    void set_remote_wake(std::function<void()> wake) { m_remote_wake = std::move(wake); }
+    // Whether other threads posted resumptions that the next batch takes.
+    bool remote_pending() const noexcept { return !m_remote.empty(); }
+#endif
+
+    size_t size() const noexcept {
+        size_t total = 0;
+        for (auto& ready : m_ready) total += ready.size();
+        return total;
+    }
+    size_t size(Priority priority) const noexcept { return m_ready[level(priority)].size(); }
+    bool empty() const noexcept { return size() == 0; }
+    size_t peak_size() const noexcept { return m_peak_size; }
+    uint64_t resumed() const noexcept { return m_resumed; }
+    uint64_t batches() const noexcept { return m_batches; }
+    uint64_t yields() const noexcept { return m_yields; }
+
+   private:
+#ifdef PROMISE_THREADS
+    // Only the first poster after the loop went to sleep pays for the system call.
+    void wake() {
+        if (m_remote_wake) return m_remote_wake();
+        if (!m_sleeping.load() || !m_sleeping.exchange(false)) return;
+#ifdef __linux__
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = write(m_wake_fd, &one, sizeof(one));
+#else
+        m_sleeping.notify_one();
+#endif
+    }
+#endif
+    static size_t level(Priority priority) noexcept { return static_cast<size_t>(priority); }
+    // The most starved lower priority, otherwise the highest one with work, priority_count if all are empty.
+    size_t pick() const noexcept {
+        for (size_t i = priority_count; i-- > 0;) {
+            if (!m_ready[i].empty() && m_passed[i] >= m_starvation_limit) return i;
+        }
+        for (size_t i = 0; i < priority_count; i++) {
+            if (!m_ready[i].empty()) return i;
+        }
+        return priority_count;
+    }
+    void run(Coroutine::Handle& handle) {
+        m_budget_left = m_budget;
+        if (!handle->started()) {
+            handle->start();
+        } else if (!handle->done()) {
+            handle->resume();
+        }
+    }
+    std::array<std::deque<Coroutine::Handle>, priority_count> m_ready;
+    std::array<size_t, priority_count> m_passed{};
+#ifdef PROMISE_THREADS
+    std::atomic<std::thread::id> m_owner = std::this_thread::get_id();
+    detail::RemoteQueue m_remote;
+    std::atomic<bool> m_sleeping = false;
+    std::function<void()> m_remote_wake;
+#ifdef __linux__
+    int m_wake_fd = -1;
+#endif
+#endif
+    size_t m_starvation_limit;
+    size_t m_budget;
+    size_t m_budget_left = 0;
+    size_t m_peak_size = 0;
+    uint64_t m_resumed = 0;
+    uint64_t m_batches = 0;
+    uint64_t m_yields = 0;
+    bool m_running = false;
+    detail::Requeue m_requeue{*this};  // Queues the chain of a coroutine that yields, once its root suspended
+};
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::EventLoop;
+#endif
@@ -0,0 +1,136 @@
+#pragma once
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "atomic_suspension_point.h"
+#include "promise.h"
+#include "thread_pool.h"
+
+namespace promise::io {
+
+// Threads for blocking file system calls, apart from default_pool() so slow disks do not hold up computations.
+inline ThreadPool& io_pool() {
+    static ThreadPool pool(4);
+    return pool;
+}
+
+namespace detail {
+
+class File {
+   public:
+    File() = default;
+    File(const File&) = delete;
+    ~File() {
+        if (m_file) std::fclose(m_file);
+    }
+    void open(const std::string& path, const char* mode) {
+        m_file = std::fopen(path.c_str(), mode);
+        if (!m_file) throw std::system_error(errno, std::generic_category(), path);
+    }
+    std::FILE* get() const noexcept { return m_file; }
+
+   private:
+    std::FILE* m_file = nullptr;
+};
+
+// State of read_file_chunks(), shared with the read that runs on the pool. Only one read runs at a time, into the
+// buffer that the consumer does not have.
+struct ChunkReader {
+    using Buffer = std::vector<std::byte>;
+    ChunkReader(std::string path, size_t chunk_size)
+        : path(std::move(path)), buffers{Buffer(chunk_size), Buffer(chunk_size)} {}
+    std::string path;
+    File file;
+    std::array<Buffer, 2> buffers;
+    size_t read = 0;
+    std::exception_ptr error;
+    AtomicSuspensionPoint<void> done;
+};
+
+inline Promise<void> read_chunk(std::shared_ptr<ChunkReader> reader, size_t buffer) {
+    try {
+        if (!reader->file.get()) reader->file.open(reader->path, "rb");
+        auto& data = reader->buffers[buffer];
+        reader->read = std::fread(data.data(), 1, data.size(), reader->file.get());
+        if (reader->read < data.size() && std::ferror(reader->file.get())) {
+            throw std::system_error(errno, std::generic_category(), reader->path);
+        }
+    } catch (...) {
+        reader->error = std::current_exception();
+    }
+    reader->done.resume();
+    co_return;
+}
+inline void start_read(const std::shared_ptr<ChunkReader>& reader, size_t buffer) {
+    io_pool().spawn(read_chunk(reader, buffer));
+}
+
+// State of async_write_file(), shared with the write that runs on the pool like ChunkReader, so the write never
+// touches the frame of the caller.
+struct FileWrite {
+    FileWrite(std::string path, std::span<const std::byte> data, bool append)
+        : path(std::move(path)), data(data), append(append) {}
+    std::string path;
+    std::span<const std::byte> data;
+    bool append;
+    std::exception_ptr error;
+    AtomicSuspensionPoint<void> done;
+};
+
+inline Promise<void> write_file(std::shared_ptr<FileWrite> write) {
+    try {
+        File file;
+        file.open(write->path, write->append ? "ab" : "wb");
+        if (std::fwrite(write->data.data(), 1, write->data.size(), file.get()) < write->data.size() ||
+            std::fflush(file.get())) {
+            throw std::system_error(errno, std::generic_category(), write->path);
+        }
+    } catch (...) {
+        write->error = std::current_exception();
+    }
+    write->done.resume();
+    co_return;
+}
+
+}  // namespace detail
+
+// Yields the file at path in chunks of chunk_size bytes, only the last one may be shorter. The reads run on io_pool()
+// and the next chunk is read while the consumer handles the current one, so the memory use is two chunks whatever
+// the size of the file. A chunk is valid until the generator is resumed, consume it with co_await pull(). The
+// consumer continues on the executor of its chain, without one on the I/O thread. Errors throw std::system_error.
+inline Promise<void, std::span<const std::byte>> read_file_chunks(std::string path, size_t chunk_size = 64 * 1024) {
+    auto reader = std::make_shared<detail::ChunkReader>(std::move(path), chunk_size);
+    size_t current = 0;
+    detail::start_read(reader, current);
+    for (;;) {
+        co_await reader->done;
+        if (reader->error) std::rethrow_exception(reader->error);
+        size_t size = reader->read;
+        if (!size) break;
+        bool last = size < chunk_size;
+        if (!last) detail::start_read(reader, current ^ 1);
+        co_yield std::span<const std::byte>(reader->buffers[current].data(), size);
+        if (last) break;
+        current ^= 1;
+    }
+}
+
+// Writes data to the file at path on io_pool(), replacing the file unless append is set. data must stay valid until
+// the write finished, which may be after the returned Promise was dropped. Errors throw std::system_error.
+inline Promise<void> async_write_file(std::string path, std::span<const std::byte> data, bool append = false) {
+    auto write = std::make_shared<detail::FileWrite>(std::move(path), data, append);
+    io_pool().spawn(detail::write_file(write));
+    co_await write->done;
+    if (write->error) std::rethrow_exception(write->error);
+}
+
+}  // namespace promise::io
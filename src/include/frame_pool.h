@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <new>
+
+namespace promise::detail {
+
+// Free lists of coroutine frames by size class, for a thread that keeps creating and destroying short coroutines like
+// a Shard. A thread only reuses frames while it installed a pool with FramePool::Scope, the others and frames that
+// are larger than max_size use the global operator new. Frames are rounded up to their size class either way, so a
+// frame may be freed into the pool of any thread, and every cached frame came from the global operator new.
+class FramePool {
+   public:
+    static constexpr size_t granularity = 64;
+    static constexpr size_t max_size = 1024;
+    static constexpr size_t max_cached = 256;  // Frames kept per size class, more go back to operator delete
+
+    // Installs pool for the calling thread while the scope lives.
+    class Scope {
+       public:
+        explicit Scope(FramePool& pool) : m_previous(current) { current = &pool; }
+        Scope(const Scope&) = delete;
+        ~Scope() { current = m_previous; }
+
+       private:
+        FramePool* m_previous;
+    };
+
+    FramePool() = default;
+    FramePool(const FramePool&) = delete;
+    ~FramePool() {
+        for (size_t i = 0; i < classes; i++) {
+            while (auto block = m_free[i]) {
+                m_free[i] = block->next;
+                ::operator delete(block, (i + 1) * granularity);
+            }
+        }
+    }
+
+    // Rounds size up to the size of its class, sizes above max_size stay as they are.
+    static constexpr size_t round(size_t size) noexcept {
+        return size <= max_size ? (size + granularity - 1) / granularity * granularity : size;
+    }
+    // The pool of the calling thread, nullptr outside of a Scope.
+    static FramePool* local() noexcept { return current; }
+
+    // Frames of the pool that are free for reuse.
+    size_t cached() const noexcept {
+        size_t total = 0;
+        for (size_t count : m_count) total += count;
+        return total;
+    }
+
+    void* allocate(size_t size) {
+        if (size <= max_size && size) {
+            size_t i = index(size);
+            if (auto block = m_free[i]) {
+                m_free[i] = block->next;
+                m_count[i]--;
+                return block;
+            }
+        }
+        return ::operator new(round(size));
+    }
+    void deallocate(void* frame, size_t size) noexcept {
+        if (size <= max_size && size) {
+            size_t i = index(size);
+            if (m_count[i] < max_cached) {
+                m_free[i] = new (frame) Block{m_free[i]};
+                m_count[i]++;
+                return;
+            }
+        }
+        ::operator delete(frame, round(size));
+    }
+
+   private:
+    static constexpr size_t classes = max_size / granularity;
+    static size_t index(size_t size) noexcept { return (size - 1) / granularity; }
+
+    struct Block {
+        Block* next;
+    };
+    std::array<Block*, classes> m_free{};
+    std::array<size_t, classes> m_count{};
+    static inline thread_local FramePool* current = nullptr;
+};
+
+// Frame memory of the calling thread, from its FramePool while it has one.
+inline void* allocate_frame(size_t size) {
+    if (auto pool = FramePool::local()) return pool->allocate(size);
+    return ::operator new(FramePool::round(size));
+}
+inline void free_frame(void* frame, size_t size) noexcept {
+    if (auto pool = FramePool::local()) return pool->deallocate(frame, size);
+    ::operator delete(frame, FramePool::round(size));
+}
+
+}  // namespace promise::detail
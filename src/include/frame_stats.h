@@ -0,0 +1,237 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <source_location>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frame_pool.h"
+#include "sharded_counters.h"
+
+// Allocation accounting for coroutine frames: frame size, allocations and live and peak counts per coroutine function.
+// Define PROMISE_FRAME_STATS (in every translation unit) to record them. Either way frames come from frame_pool.h.
+
+namespace promise::frames {
+
+#ifdef PROMISE_FRAME_STATS
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+struct FunctionStats {
+    std::string function;
+    std::string file;
+    uint32_t line = 0;
+    size_t frame_size = 0;  // Bytes per frame, including the accounting header
+    uint64_t allocations = 0;
+    uint64_t live = 0;
+    uint64_t peak_live = 0;
+};
+
+struct Totals {
+    uint64_t live_bytes = 0;
+    uint64_t peak_bytes = 0;
+};
+
+namespace detail {
+
+using promise::detail::bump;
+using promise::detail::ShardedRegistry;
+
+// Live and peak counts of a function on one thread. A frame may be freed on another thread than the one that
+// allocated it, so the live count of a thread can go below zero, only the sum over the threads is meaningful.
+struct Counters {
+    std::atomic<uint64_t> allocations{};
+    std::atomic<int64_t> live{};
+    std::atomic<int64_t> peak{};  // Highest live count of this thread
+};
+
+// Byte totals of one thread, counted like the live and peak counts.
+struct Bytes {
+    std::atomic<int64_t> live{};
+    std::atomic<int64_t> peak{};
+};
+
+struct Function {
+    Function(const std::source_location& loc, uint32_t id)
+        : name(loc.function_name()), file(loc.file_name()), line(loc.line()), id(id) {}
+    std::string name;
+    std::string file;
+    uint32_t line;
+    uint32_t id;
+    std::atomic<size_t> frame_size{};  // Set by the first allocation on every thread
+};
+
+// Adds by to the counter of the owning thread and raises the peak of the thread.
+inline void count(std::atomic<int64_t>& live, std::atomic<int64_t>& peak, int64_t by) noexcept {
+    bump(live, by);
+    int64_t now = live.load(std::memory_order_relaxed);
+    if (now > peak.load(std::memory_order_relaxed)) peak.store(now, std::memory_order_relaxed);
+}
+
+// What a thread keeps besides its counters: the functions it allocated for, keyed by the address of the function name
+// literal, and its byte totals.
+struct Local {
+    std::unordered_map<const char*, Function*> functions;
+    Bytes bytes;
+};
+
+// Counts of the threads that finished.
+struct Retired {
+    uint64_t allocations = 0;
+    int64_t live = 0;
+    int64_t peak = 0;
+};
+
+// Peaks are merged as the sum of the peaks of the threads. That is the true peak when the frames of a function are
+// created and destroyed on one thread, and an upper bound of it otherwise.
+class Registry : public ShardedRegistry<Registry, Counters, Local> {
+   public:
+    // Functions are merged by name, so the same inline coroutine seen from several translation units counts once.
+    Function* add(const std::source_location& loc) {
+        std::lock_guard lock(m_mutex);
+        auto [it, inserted] = m_ids.try_emplace(loc.function_name(), (uint32_t) m_functions.size());
+        if (inserted) m_functions.push_back(std::make_unique<Function>(loc, it->second));
+        return m_functions[it->second].get();
+    }
+    std::vector<FunctionStats> snapshot() {
+        std::lock_guard lock(m_mutex);
+        std::vector<FunctionStats> result;
+        for (uint32_t id = 0; id < m_functions.size(); id++) {
+            auto& f = *m_functions[id];
+            Retired sum = id < m_retired.size() ? m_retired[id] : Retired{};
+            for_each_thread(id, [&](const Counters& counters) {
+                sum.allocations += counters.allocations.load(std::memory_order_relaxed);
+                sum.live += counters.live.load(std::memory_order_relaxed);
+                sum.peak += counters.peak.load(std::memory_order_relaxed);
+            });
+            FunctionStats stats{f.name, f.file, f.line};
+            stats.frame_size = f.frame_size.load(std::memory_order_relaxed);
+            stats.allocations = sum.allocations;
+            stats.live = (uint64_t) std::max<int64_t>(sum.live, 0);
+            stats.peak_live = (uint64_t) std::max(sum.peak, sum.live);
+            result.push_back(std::move(stats));
+        }
+        return result;
+    }
+    Totals totals() {
+        std::lock_guard lock(m_mutex);
+        int64_t live = m_retired_bytes.live, peak = m_retired_bytes.peak;
+        for_each_shard([&](const Shard& shard) {
+            live += shard.local.bytes.live.load(std::memory_order_relaxed);
+            peak += shard.local.bytes.peak.load(std::memory_order_relaxed);
+        });
+        return {(uint64_t) std::max<int64_t>(live, 0), (uint64_t) std::max(peak, live)};
+    }
+
+    // Counts a frame of a thread that already destroyed its shard, straight into the retired counts.
+    void count_late(Function& function, size_t size, int64_t frames) {
+        std::lock_guard lock(m_mutex);
+        if (m_retired.size() <= function.id) m_retired.resize(function.id + 1);
+        auto& retired = m_retired[function.id];
+        if (frames > 0) {
+            retired.allocations++;
+            function.frame_size.store(size, std::memory_order_relaxed);
+        }
+        retired.live += frames;
+        retired.peak = std::max(retired.peak, retired.live);
+        m_retired_bytes.live += frames * (int64_t) size;
+        m_retired_bytes.peak = std::max(m_retired_bytes.peak, m_retired_bytes.live);
+    }
+
+   private:
+    friend class ShardedRegistry<Registry, Counters, Local>;
+    // Keeps the counts of a finishing thread.
+    void retire(const Shard& shard) {
+        if (m_retired.size() < m_functions.size()) m_retired.resize(m_functions.size());
+        shard.for_each([&](uint32_t id, const Counters& counters) {
+            m_retired[id].allocations += counters.allocations.load(std::memory_order_relaxed);
+            m_retired[id].live += counters.live.load(std::memory_order_relaxed);
+            m_retired[id].peak += counters.peak.load(std::memory_order_relaxed);
+        });
+        m_retired_bytes.live += shard.local.bytes.live.load(std::memory_order_relaxed);
+        m_retired_bytes.peak += shard.local.bytes.peak.load(std::memory_order_relaxed);
+    }
+    std::map<std::string, uint32_t> m_ids;
+    std::vector<std::unique_ptr<Function>> m_functions;
+    std::vector<Retired> m_retired;
+    Retired m_retired_bytes;
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+inline Counters& counters(Registry::Shard& shard, Function& function, size_t frame_size) {
+    if (auto counters = shard.find(function.id)) return *counters;
+    function.frame_size.store(frame_size, std::memory_order_relaxed);
+    return shard.emplace(function.id);
+}
+
+// Every accounted frame is preceded by a header that tells which function it belongs to.
+struct Header {
+    Function* function;
+};
+constexpr size_t header_size = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+static_assert(sizeof(Header) <= header_size);
+
+inline void* allocate(size_t size, const std::source_location& loc) {
+    size += header_size;
+    auto shard = registry().local();
+    Function* function;
+    if (!shard) {
+        function = registry().add(loc);
+        registry().count_late(*function, size, 1);
+    } else {
+        auto& functions = shard->local.functions;
+        auto it = functions.find(loc.function_name());
+        if (it == functions.end()) it = functions.emplace(loc.function_name(), registry().add(loc)).first;
+        function = it->second;
+        auto& c = counters(*shard, *function, size);
+        bump(c.allocations);
+        count(c.live, c.peak, 1);
+        count(shard->local.bytes.live, shard->local.bytes.peak, (int64_t) size);
+    }
+    void* memory = promise::detail::allocate_frame(size);
+    new (memory) Header{function};
+    return static_cast<char*>(memory) + header_size;
+}
+
+inline void deallocate(void* frame, size_t size) {
+    size += header_size;
+    void* memory = static_cast<char*>(frame) - header_size;
+    Header* header = std::launder(static_cast<Header*>(memory));
+    if (auto shard = registry().local()) {
+        bump(counters(*shard, *header->function, size).live, int64_t{-1});
+        bump(shard->local.bytes.live, -(int64_t) size);
+    } else {
+        registry().count_late(*header->function, size, -1);
+    }
+    promise::detail::free_frame(memory, size);
+}
+
+}  // namespace detail
+
+inline std::vector<FunctionStats> snapshot() { return detail::registry().snapshot(); }
+inline Totals totals() { return detail::registry().totals(); }
+
+// Writes one line per coroutine function that allocated a frame, followed by the byte totals.
+inline void dump(std::ostream& out) {
+    for (auto& f : snapshot()) {
+        out << f.function << " (" << f.file << ":" << f.line << ") frame=" << f.frame_size
+            << " allocations=" << f.allocations << " live=" << f.live << " peak=" << f.peak_live << "\n";
+    }
+    auto t = totals();
+    out << "live_bytes=" << t.live_bytes << " peak_bytes=" << t.peak_bytes << "\n";
+}
+
+}  // namespace promise::frames
@@ -1,130 +1,220 @@
 #pragma once
 #include <functional>
-#include <vector>
 
 #include "promise.h"
 #include "hook_helper.h"
+#include "hook_stats.h"
 
 namespace promise {
 
+// Observable function: hooks that run before and after every call of the impl, which returns right away. The impl is a
+// std::function, or the member function of a class that derives through BasicObservableFunction, like those
+// NON_BLOCKING_HOOK declares. Calls through an ObservableFunction& reach the impl of such a class through one function
+// pointer.
 template <typename R, typename... Args> class ObservableFunction {
    public:
-    using Hook = std::function<void(Args...)>;
+    using Impl = std::function<R(Args...)>;
+    using Hook = std::function<void(const Args&...)>;
     using NoArgHook = std::function<void()>;
     using RRef = const R&;
-    using RRefHook = std::function<void(RRef, Args...)>;
+    using RRefHook = std::function<void(RRef, const Args&...)>;
     using NoArgRRefHook = std::function<void(RRef)>;
-    using Impl = std::function<R(Args...)>;
-    ObservableFunction(Impl h) : impl(h) {}
+    ObservableFunction(Impl h, const char* name = "") : ObservableFunction(name, &call_function) {
+        m_impl = detail::ImplBox<Impl>(std::move(h));
+    }
     R operator()(Args... args) {
-        preHooks(std::forward<Args>(args)...);
-        R result = impl(std::forward<Args>(args)...);
-        postHooks(result, std::forward<Args>(args)...);
-        return result;
+        return dispatch([this](auto&&... a) -> R { return m_call(*this, std::forward<decltype(a)>(a)...); }, args...);
     }
     class PostHookList {
        private:
-        std::vector<RRefHook> hooks;
-        void operator()(RRef result, Args... args) {
-            for (auto& hook : hooks) {
-                hook(result, std::forward<Args>(args)...);
+        detail::HookSlots<stats::Measured<RRefHook>> hooks;
+        [[no_unique_address]] stats::Name m_owner;
+        uint32_t m_added = 0;
+        void name(const stats::Name& owner, const char*) { m_owner = owner; }
+        HookToken add(RRefHook h) { return hooks.add({std::move(h), stats::Site(m_owner, "post", m_added++)}); }
+        void operator()(RRef result, const Args&... args) {
+            auto guard = hooks.dispatch();
+            for (size_t i = 0, n = hooks.size(); i < n; i++) {
+                if (auto hook = hooks.get(i)) hook->site.call(hook->fn, result, args...);
             }
         }
         friend class ObservableFunction;
 
        public:
-        void operator+=(RRefHook h) { hooks.push_back(h); }
-        void operator+=(Hook h) {
+        bool empty() const { return hooks.empty(); }
+        HookToken operator+=(RRefHook h) { return add(std::move(h)); }
+        HookToken operator+=(Hook h) {
             static_assert(!detail::ambiguous_return_and_arguments<R, Args...>,
                           "The type of hook is ambiguous. Use .argHook() or .resultHook() to disambiguate.");
-            argHook(h);
+            return argHook(std::move(h));
         }
-        void argHook(Hook h) {
-            hooks.push_back([h](RRef, Args... args) { return h(std::forward<Args>(args)...); });
+        HookToken argHook(Hook h) {
+            return add([h](RRef, const Args&... args) { return h(args...); });
         }
-        void operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
-            hooks.push_back([h](RRef, Args...) { return h(); });
+        HookToken operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
+            return add([h](RRef, const Args&...) { return h(); });
         }
-        void operator+=(NoArgRRefHook h)
+        HookToken operator+=(NoArgRRefHook h)
             requires(sizeof...(Args) > 0 && !detail::ambiguous_return_and_arguments<R, Args...>) {
-            resultHook(h);
+            return resultHook(std::move(h));
         }
-        void resultHook(NoArgRRefHook h) {
-            hooks.push_back([h](RRef r, Args...) { return h(r); });
+        HookToken resultHook(NoArgRRefHook h) {
+            return add([h](RRef r, const Args&...) { return h(r); });
         }
     } postHooks;
     class PreHookList {
        private:
-        std::vector<Hook> hooks;
-        void operator()(Args... args) {
-            for (auto& hook : hooks) {
-                hook(std::forward<Args>(args)...);
+        detail::HookSlots<stats::Measured<Hook>> hooks;
+        [[no_unique_address]] stats::Name m_owner;
+        const char* m_kind = "";
+        uint32_t m_added = 0;
+        void name(const stats::Name& owner, const char* kind) {
+            m_owner = owner;
+            m_kind = kind;
+        }
+        HookToken add(Hook h) { return hooks.add({std::move(h), stats::Site(m_owner, m_kind, m_added++)}); }
+        void operator()(const Args&... args) {
+            auto guard = hooks.dispatch();
+            for (size_t i = 0, n = hooks.size(); i < n; i++) {
+                if (auto hook = hooks.get(i)) hook->site.call(hook->fn, args...);
             }
         }
         friend class ObservableFunction;
 
        public:
-        void operator+=(Hook h) { hooks.push_back(h); }
-        void operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
-            hooks.push_back([h](Args...) { return h(); });
+        bool empty() const { return hooks.empty(); }
+        HookToken operator+=(Hook h) { return add(std::move(h)); }
+        HookToken operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
+            return add([h](const Args&...) { return h(); });
         }
     } preHooks;
 
+   protected:
+    using Call = R (*)(ObservableFunction&, Args...);
+    ObservableFunction(const char* name, Call call)
+        : ObservableFunction(stats::name_of(name, "ObservableFunction"), call) {}
+    ObservableFunction(const stats::Name& name, Call call) : m_call(call), m_site(name) {
+        preHooks.name(name, "pre");
+        postHooks.name(name, "post");
+    }
+    template <typename F> R dispatch(F call_impl, Args&... args) {
+        preHooks(args...);
+        // The arguments are moved into the impl when no post hook needs them. Post hooks the impl subscribes during such
+        // a call run from the next call on, like those of ObservablePromise.
+        bool keep = !postHooks.empty();
+        R result = keep ? m_site.call(call_impl, args...) : m_site.call(call_impl, std::forward<Args>(args)...);
+        if (keep) postHooks(result, args...);
+        return result;
+    }
+
    private:
-    Impl impl;
+    static R call_function(ObservableFunction& o, Args... args) { return (*o.m_impl)(std::forward<Args>(args)...); }
+    Call m_call;
+    detail::ImplBox<Impl> m_impl;  // Empty unless the impl is given at runtime
+    [[no_unique_address]] stats::Site m_site;
 };
 template <typename... Args> class ObservableFunction<void, Args...> {
    public:
-    using Hook = std::function<void(Args...)>;
+    using Impl = std::function<void(Args...)>;
+    using Hook = std::function<void(const Args&...)>;
     using NoArgHook = std::function<void()>;
     using R = void;
-    using Impl = std::function<R(Args...)>;
-    ObservableFunction(Impl h) : impl(h) {}
+    ObservableFunction(Impl h, const char* name = "") : ObservableFunction(name, &call_function) {
+        m_impl = detail::ImplBox<Impl>(std::move(h));
+    }
     R operator()(Args... args) {
-        preHooks(std::forward<Args>(args)...);
-        if constexpr (std::is_void<R>()) {
-            impl(std::forward<Args>(args)...);
-            postHooks(std::forward<Args>(args)...);
-        } else {
-            auto result = impl(std::forward<Args>(args)...);
-            postHooks(std::forward<Args>(args)...);
-            return result;
-        }
+        dispatch([this](auto&&... a) { m_call(*this, std::forward<decltype(a)>(a)...); }, args...);
     }
     class PreHookList {
        private:
-        std::vector<Hook> hooks;
-        void operator()(Args... args) {
-            for (auto& hook : hooks) {
-                hook(std::forward<Args>(args)...);
+        detail::HookSlots<stats::Measured<Hook>> hooks;
+        [[no_unique_address]] stats::Name m_owner;
+        const char* m_kind = "";
+        uint32_t m_added = 0;
+        void name(const stats::Name& owner, const char* kind) {
+            m_owner = owner;
+            m_kind = kind;
+        }
+        HookToken add(Hook h) { return hooks.add({std::move(h), stats::Site(m_owner, m_kind, m_added++)}); }
+        void operator()(const Args&... args) {
+            auto guard = hooks.dispatch();
+            for (size_t i = 0, n = hooks.size(); i < n; i++) {
+                if (auto hook = hooks.get(i)) hook->site.call(hook->fn, args...);
             }
         }
         friend class ObservableFunction;
 
        public:
-        void operator+=(Hook h) { hooks.push_back(h); }
-        void operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
-            hooks.push_back([h](Args...) { return h(); });
+        bool empty() const { return hooks.empty(); }
+        HookToken operator+=(Hook h) { return add(std::move(h)); }
+        HookToken operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
+            return add([h](const Args&...) { return h(); });
         }
     } preHooks, postHooks;
 
+   protected:
+    using Call = R (*)(ObservableFunction&, Args...);
+    ObservableFunction(const char* name, Call call)
+        : ObservableFunction(stats::name_of(name, "ObservableFunction"), call) {}
+    ObservableFunction(const stats::Name& name, Call call) : m_call(call), m_site(name) {
+        preHooks.name(name, "pre");
+        postHooks.name(name, "post");
+    }
+    template <typename F> void dispatch(F call_impl, Args&... args) {
+        preHooks(args...);
+        // Same rule as the general case
+        if (postHooks.empty()) {
+            m_site.call(call_impl, std::forward<Args>(args)...);
+        } else {
+            m_site.call(call_impl, args...);
+            postHooks(args...);
+        }
+    }
+
+   private:
+    static void call_function(ObservableFunction& o, Args... args) { (*o.m_impl)(std::forward<Args>(args)...); }
+    Call m_call;
+    detail::ImplBox<Impl> m_impl;  // Empty unless the impl is given at runtime
+    [[no_unique_address]] stats::Site m_site;
+};
+
+// Base of observable functions whose impl is a member callable `impl` of Self. Calls on the object itself reach the
+// impl directly and can be inlined.
+template <typename Self, typename R, typename... Args>
+class BasicObservableFunction : public ObservableFunction<R, Args...> {
+   public:
+    R operator()(Args... args) {
+        return this->dispatch([this](auto&&... a) -> R { return derived().impl(std::forward<decltype(a)>(a)...); },
+                              args...);
+    }
+
+   protected:
+    BasicObservableFunction(const char* name) : ObservableFunction<R, Args...>(name, &call_member) {}
+
    private:
-    Impl impl;
+    Self& derived() { return static_cast<Self&>(*this); }
+    static R call_member(ObservableFunction<R, Args...>& o, Args... args) {
+        return static_cast<Self&>(o).impl(std::forward<Args>(args)...);
+    }
 };
 
-#define NON_BLOCKING_HOOK(result, Parent, name, ...)                                                         \
-    class name : public ObservableFunction<result __VA_OPT__(, __VA_ARGS__)> {                               \
-        Parent* self;                                                                                               \
-        result impl(__VA_ARGS__);                                                                   \
-        name(Parent* p)                                                                                             \
-            : ObservableFunction<result __VA_OPT__(, __VA_ARGS__)>(promise::bind_member(&name::impl, this)), \
-              self(p) {}                                                                                            \
-        friend class Parent;                                                                                        \
-    } name{this};                                                                                                   \
+// The impl is a member function of the generated class, so calls on the hook reach it directly and can be inlined. Like
+// HOOK, the class is still an ObservableFunction<result, Args...>.
+#define NON_BLOCKING_HOOK(result, Parent, name, ...)                                                        \
+    class name : public promise::BasicObservableFunction<name, result __VA_OPT__(, __VA_ARGS__)> {          \
+        Parent* self;                                                                                       \
+        result impl(__VA_ARGS__);                                                                           \
+        name(Parent* p)                                                                                     \
+            : promise::BasicObservableFunction<name, result __VA_OPT__(, __VA_ARGS__)>(#Parent "::" #name), \
+              self(p) {}                                                                                    \
+        friend class promise::BasicObservableFunction<name, result __VA_OPT__(, __VA_ARGS__)>;              \
+        friend class Parent;                                                                                \
+    } name{this};                                                                                           \
     friend class name
 
 }  // namespace promise
 
 #ifdef GLOBAL_PROMISE
+using promise::BasicObservableFunction;
 using promise::ObservableFunction;
 #endif
@@ -1,133 +1,252 @@
 #pragma once
 #include <functional>
-#include <vector>
 
 #include "promise.h"
 #include "hook_helper.h"
+#include "hook_stats.h"
 
 namespace promise {
 
+// Observable promise: hooks that run before and after every call of the impl. The impl is a std::function, or the
+// member function of a class that derives through BasicObservablePromise, like those HOOK declares. Calls through an
+// ObservablePromise& reach the impl of such a class through one function pointer.
 template <typename R, typename Y, typename... Args> class ObservablePromise {
    public:
-    using Hook = std::function<Promise<void, Y>(Args...)>;
+    using Impl = std::function<Promise<R, Y>(Args...)>;
+    using Hook = std::function<Promise<void, Y>(const Args&...)>;
     using NoArgHook = std::function<Promise<void, Y>()>;
     using RRef = const R&;
-    using ResultHook = std::function<Promise<void, Y>(R, Args...)>;
-    using RRefHook = std::function<Promise<void, Y>(RRef, Args...)>;
+    using ResultHook = std::function<Promise<void, Y>(R, const Args&...)>;
+    using RRefHook = std::function<Promise<void, Y>(RRef, const Args&...)>;
     using NoArgResultHook = std::function<Promise<void, Y>(R)>;
     using NoArgRRefHook = std::function<Promise<void, Y>(RRef)>;
-    using Impl = std::function<Promise<R, Y>(Args...)>;
-    ObservablePromise(Impl h) : impl(h) {}
+    ObservablePromise(Impl h, const char* name = "") : ObservablePromise(name, &call_function) {
+        m_impl = detail::ImplBox<Impl>(std::move(h));
+    }
     Promise<R, Y> operator()(Args... args) {
-        co_await preHooks(std::forward<Args>(args)...);
-        R result = co_await impl(std::forward<Args>(args)...);
-        co_await postHooks(result, std::forward<Args>(args)...);
-        co_return result;
+        return dispatch([this](auto&&... a) { return m_call(*this, std::forward<decltype(a)>(a)...); },
+                        std::forward<Args>(args)...);
     }
     class PostHookList {
        private:
-        std::vector<RRefHook> hooks;
-        Promise<void, Y> operator()(RRef result, Args... args) {
-            for (auto& hook : hooks) {
-                co_await hook(result, std::forward<Args>(args)...);
+        detail::HookSlots<stats::Measured<RRefHook>> hooks;
+        [[no_unique_address]] stats::Name m_owner;
+        uint32_t m_added = 0;
+        void name(const stats::Name& owner, const char*) { m_owner = owner; }
+        HookToken add(RRefHook h) { return hooks.add({std::move(h), stats::Site(m_owner, "post", m_added++)}); }
+        Promise<void, Y> operator()(RRef result, const Args&... args) {
+            auto guard = hooks.dispatch();
+            for (size_t i = 0, n = hooks.size(); i < n; i++) {
+                if (auto hook = hooks.get(i)) {
+                    auto call = hook->fn(result, args...);
+                    stats::Site::Timing timing;
+                    if constexpr (stats::enabled) timing = hook->site.start(call, co_await this_coroutine);
+                    co_await call;
+                    timing.finish();
+                }
             }
         }
         friend class ObservablePromise;
 
        public:
-        void operator+=(RRefHook h) { hooks.push_back(h); }
-        void operator+=(Hook h) {
+        bool empty() const { return hooks.empty(); }
+        HookToken operator+=(RRefHook h) { return add(std::move(h)); }
+        HookToken operator+=(Hook h) {
             static_assert(!detail::ambiguous_return_and_arguments<R, Args...>,
                           "The type of hook is ambiguous. Use .argHook() or .resultHook() to disambiguate.");
-            argHook(h);
+            return argHook(std::move(h));
         }
-        void argHook(Hook h) {
-            hooks.push_back([h](RRef, Args... args) { return h(std::forward<Args>(args)...); });
+        HookToken argHook(Hook h) {
+            return add([h](RRef, const Args&... args) { return h(args...); });
         }
-        void operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
-            hooks.push_back([h](RRef, Args...) { return h(); });
+        HookToken operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
+            return add([h](RRef, const Args&...) { return h(); });
         }
-        void operator+=(NoArgRRefHook h)
+        HookToken operator+=(NoArgRRefHook h)
             requires(sizeof...(Args) > 0 && !detail::ambiguous_return_and_arguments<R, Args...>) {
-            resultHook(h);
+            return resultHook(std::move(h));
         }
-        void resultHook(NoArgRRefHook h) {
-            hooks.push_back([h](RRef r, Args...) { return h(r); });
+        HookToken resultHook(NoArgRRefHook h) {
+            return add([h](RRef r, const Args&...) { return h(r); });
         }
     } postHooks;
     class PreHookList {
        private:
-        std::vector<Hook> hooks;
-        Promise<void, Y> operator()(Args... args) {
-            for (auto& hook : hooks) {
-                co_await hook(std::forward<Args>(args)...);
+        detail::HookSlots<stats::Measured<Hook>> hooks;
+        [[no_unique_address]] stats::Name m_owner;
+        const char* m_kind = "";
+        uint32_t m_added = 0;
+        void name(const stats::Name& owner, const char* kind) {
+            m_owner = owner;
+            m_kind = kind;
+        }
+        HookToken add(Hook h) { return hooks.add({std::move(h), stats::Site(m_owner, m_kind, m_added++)}); }
+        Promise<void, Y> operator()(const Args&... args) {
+            auto guard = hooks.dispatch();
+            for (size_t i = 0, n = hooks.size(); i < n; i++) {
+                if (auto hook = hooks.get(i)) {
+                    auto call = hook->fn(args...);
+                    stats::Site::Timing timing;
+                    if constexpr (stats::enabled) timing = hook->site.start(call, co_await this_coroutine);
+                    co_await call;
+                    timing.finish();
+                }
             }
         }
         friend class ObservablePromise;
 
        public:
-        void operator+=(Hook h) { hooks.push_back(h); }
-        void operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
-            hooks.push_back([h](Args...) { return h(); });
+        bool empty() const { return hooks.empty(); }
+        HookToken operator+=(Hook h) { return add(std::move(h)); }
+        HookToken operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
+            return add([h](const Args&...) { return h(); });
         }
     } preHooks;
 
+   protected:
+    using Call = Promise<R, Y> (*)(ObservablePromise&, Args...);
+    ObservablePromise(const char* name, Call call)
+        : ObservablePromise(stats::name_of(name, "ObservablePromise"), call) {}
+    ObservablePromise(const stats::Name& name, Call call) : m_call(call), m_site(name) {
+        preHooks.name(name, "pre");
+        postHooks.name(name, "post");
+    }
+    template <typename F> Promise<R, Y> dispatch(F call_impl, Args... args) {
+        co_await preHooks(args...);
+        // The arguments are moved into the impl when no post hook needs them. Post hooks subscribed during such a call,
+        // while the impl is suspended, run from the next call on.
+        bool keep = !postHooks.empty();
+        auto call = keep ? call_impl(args...) : call_impl(std::forward<Args>(args)...);
+        stats::Site::Timing timing;  // Without statistics this coroutine is not looked up
+        if constexpr (stats::enabled) timing = m_site.start(call, co_await this_coroutine);
+        R result = co_await call;
+        timing.finish();
+        if (keep) co_await postHooks(result, args...);
+        co_return result;
+    }
+
    private:
-    Impl impl;
+    static Promise<R, Y> call_function(ObservablePromise& o, Args... args) {
+        return (*o.m_impl)(std::forward<Args>(args)...);
+    }
+    Call m_call;
+    detail::ImplBox<Impl> m_impl;  // Empty unless the impl is given at runtime
+    [[no_unique_address]] stats::Site m_site;
 };
 template <typename Y, typename... Args> class ObservablePromise<void, Y, Args...> {
    public:
-    using Hook = std::function<Promise<void, Y>(Args...)>;
+    using Impl = std::function<Promise<void, Y>(Args...)>;
+    using Hook = std::function<Promise<void, Y>(const Args&...)>;
     using NoArgHook = std::function<Promise<void, Y>()>;
     using R = void;
-    using Impl = std::function<Promise<R, Y>(Args...)>;
-    ObservablePromise(Impl h) : impl(h) {}
+    ObservablePromise(Impl h, const char* name = "") : ObservablePromise(name, &call_function) {
+        m_impl = detail::ImplBox<Impl>(std::move(h));
+    }
     Promise<R, Y> operator()(Args... args) {
-        co_await preHooks(std::forward<Args>(args)...);
-        if constexpr (std::is_void<R>()) {
-            co_await impl(std::forward<Args>(args)...);
-            co_await postHooks(std::forward<Args>(args)...);
-        } else {
-            auto result = co_await impl(std::forward<Args>(args)...);
-            co_await postHooks(std::forward<Args>(args)...);
-            co_return result;
-        }
+        return dispatch([this](auto&&... a) { return m_call(*this, std::forward<decltype(a)>(a)...); },
+                        std::forward<Args>(args)...);
     }
     class PreHookList {
        private:
-        std::vector<Hook> hooks;
-        Promise<void, Y> operator()(Args... args) {
-            for (auto& hook : hooks) {
-                co_await hook(std::forward<Args>(args)...);
+        detail::HookSlots<stats::Measured<Hook>> hooks;
+        [[no_unique_address]] stats::Name m_owner;
+        const char* m_kind = "";
+        uint32_t m_added = 0;
+        void name(const stats::Name& owner, const char* kind) {
+            m_owner = owner;
+            m_kind = kind;
+        }
+        HookToken add(Hook h) { return hooks.add({std::move(h), stats::Site(m_owner, m_kind, m_added++)}); }
+        Promise<void, Y> operator()(const Args&... args) {
+            auto guard = hooks.dispatch();
+            for (size_t i = 0, n = hooks.size(); i < n; i++) {
+                if (auto hook = hooks.get(i)) {
+                    auto call = hook->fn(args...);
+                    stats::Site::Timing timing;
+                    if constexpr (stats::enabled) timing = hook->site.start(call, co_await this_coroutine);
+                    co_await call;
+                    timing.finish();
+                }
             }
         }
         friend class ObservablePromise;
 
        public:
-        void operator+=(Hook h) { hooks.push_back(h); }
-        void operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
-            hooks.push_back([h](Args...) { return h(); });
+        bool empty() const { return hooks.empty(); }
+        HookToken operator+=(Hook h) { return add(std::move(h)); }
+        HookToken operator+=(NoArgHook h) requires(sizeof...(Args) > 0) {
+            return add([h](const Args&...) { return h(); });
         }
     } preHooks, postHooks;
 
+   protected:
+    using Call = Promise<R, Y> (*)(ObservablePromise&, Args...);
+    ObservablePromise(const char* name, Call call)
+        : ObservablePromise(stats::name_of(name, "ObservablePromise"), call) {}
+    ObservablePromise(const stats::Name& name, Call call) : m_call(call), m_site(name) {
+        preHooks.name(name, "pre");
+        postHooks.name(name, "post");
+    }
+    template <typename F> Promise<R, Y> dispatch(F call_impl, Args... args) {
+        co_await preHooks(args...);
+        // Same rule as the general case
+        bool keep = !postHooks.empty();
+        auto call = keep ? call_impl(args...) : call_impl(std::forward<Args>(args)...);
+        stats::Site::Timing timing;
+        if constexpr (stats::enabled) timing = m_site.start(call, co_await this_coroutine);
+        co_await call;
+        timing.finish();
+        if (keep) co_await postHooks(args...);
+    }
+
    private:
-    Impl impl;
+    static Promise<R, Y> call_function(ObservablePromise& o, Args... args) {
+        return (*o.m_impl)(std::forward<Args>(args)...);
+    }
+    Call m_call;
+    detail::ImplBox<Impl> m_impl;  // Empty unless the impl is given at runtime
+    [[no_unique_address]] stats::Site m_site;
+};
+
+// Base of observable promises whose impl is a member callable `impl` of Self, or that route the calls of it through
+// their own `call_impl`. Calls on the object itself reach the impl directly and can be inlined.
+template <typename Self, typename R, typename Y, typename... Args>
+class BasicObservablePromise : public ObservablePromise<R, Y, Args...> {
+   public:
+    Promise<R, Y> operator()(Args... args) {
+        return this->dispatch([this](auto&&... a) { return derived().call_impl(std::forward<decltype(a)>(a)...); },
+                              std::forward<Args>(args)...);
+    }
+
+   protected:
+    BasicObservablePromise(const char* name) : ObservablePromise<R, Y, Args...>(name, &call_member) {}
+
+   private:
+    Self& derived() { return static_cast<Self&>(*this); }
+    template <typename... A> Promise<R, Y> call_impl(A&&... args) { return derived().impl(std::forward<A>(args)...); }
+    static Promise<R, Y> call_member(ObservablePromise<R, Y, Args...>& o, Args... args) {
+        return static_cast<Self&>(o).call_impl(std::forward<Args>(args)...);
+    }
 };
 
-#define HOOK(result, yield, Parent, name, ...)                                       \
-    class name : public ObservablePromise<result, yield __VA_OPT__(, __VA_ARGS__)> { \
-        Parent* self;                                                                \
-        Promise<result, yield> impl(__VA_ARGS__);                                    \
-        name(Parent* p)                                                              \
-            : ObservablePromise<result, yield __VA_OPT__(, __VA_ARGS__)>(            \
-                  promise::bind_member(&name::impl, this)),                  \
-              self(p) {}                                                             \
-        friend class Parent;                                                         \
-    } name{this};                                                                    \
+// The impl is a member function of the generated class, so calls on the hook reach it directly and can be inlined. The
+// class is still an ObservablePromise<result, yield, Args...>, which takes one indirect call to reach the impl.
+#define HOOK(result, yield, Parent, name, ...)                                                           \
+    class name : public promise::BasicObservablePromise<name, result, yield __VA_OPT__(, __VA_ARGS__)> { \
+        Parent* self;                                                                                    \
+        Promise<result, yield> impl(__VA_ARGS__);                                                        \
+        name(Parent* p)                                                                                  \
+            : promise::BasicObservablePromise<name, result, yield __VA_OPT__(, __VA_ARGS__)>(            \
+                  #Parent "::" #name),                                                                   \
+              self(p) {}                                                                                 \
+        friend class promise::BasicObservablePromise<name, result, yield __VA_OPT__(, __VA_ARGS__)>;     \
+        friend class Parent;                                                                             \
+    } name{this};                                                                                        \
     friend class name
 
 }  // namespace promise
 
 #ifdef GLOBAL_PROMISE
+using promise::BasicObservablePromise;
 using promise::ObservablePromise;
 #endif
@@ -1,9 +1,15 @@
 #pragma once
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace promise {
 template <typename A, typename B, typename... Args> auto bind_member(B (A::*f)(Args...), A* a) {
-    return [f, a](Args... args) -> B { return (a->*f)(args...); };
+    return [f, a](auto&&... args) -> B { return (a->*f)(std::forward<decltype(args)>(args)...); };
 }
 
 namespace detail {
@@ -11,5 +17,231 @@ namespace detail {
 template <typename R, typename... Args>
 concept ambiguous_return_and_arguments = requires(std::function<void(Args...)> f, const R& r) { f(r); };
 
+class HookSlotsBase;
+
 };  // namespace detail
+
+// Identifies a hook inside a hook list. Discarding it keeps the hook registered.
+// A token may outlive its list, it is then no longer subscribed. Copies of the list do not share its tokens, and
+// assigning another list to it unsubscribes the tokens it gave out.
+class HookToken {
+   public:
+    HookToken() = default;
+    void unsubscribe();
+    bool subscribed() const;
+
+   private:
+    friend class detail::HookSlotsBase;
+    using Anchor = std::shared_ptr<detail::HookSlotsBase*>;
+    HookToken(Anchor list, uint32_t slot, uint32_t generation)
+        : m_list(std::move(list)), m_slot(slot), m_generation(generation) {}
+    Anchor m_list;  // Points to the list, which clears it when it is destroyed
+    uint32_t m_slot{};
+    uint32_t m_generation{};
+};
+
+// Owning version of HookToken: removes the hook when it goes out of scope.
+class Subscription {
+   public:
+    Subscription() = default;
+    Subscription(HookToken token) : m_token(token) {}
+    Subscription(Subscription&& other) : m_token(std::exchange(other.m_token, {})) {}
+    Subscription& operator=(Subscription&& other) {
+        if (this != &other) {
+            unsubscribe();
+            m_token = std::exchange(other.m_token, {});
+        }
+        return *this;
+    }
+    ~Subscription() { unsubscribe(); }
+    void unsubscribe() { std::exchange(m_token, {}).unsubscribe(); }
+    bool subscribed() const { return m_token.subscribed(); }
+    HookToken release() { return std::exchange(m_token, {}); }
+
+   private:
+    HookToken m_token;
+};
+
+namespace detail {
+
+// Bookkeeping of a slot map: hooks live densely in insertion order, slots map tokens to their current index.
+// Removal only marks the entry, the dense array is compacted once enough entries died and no dispatch is
+// running. Hooks added during a dispatch are kept aside until the last dispatch finishes.
+class HookSlotsBase {
+   public:
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+    class DispatchGuard {
+       public:
+        DispatchGuard(HookSlotsBase& list) : m_list(list) { m_list.m_dispatching++; }
+        DispatchGuard(const DispatchGuard&) = delete;
+        ~DispatchGuard() {
+            if (!--m_list.m_dispatching) m_list.settle();
+        }
+
+       private:
+        HookSlotsBase& m_list;
+    };
+
+    void remove(uint32_t slot, uint32_t generation) {
+        if (!contains(slot, generation)) return;
+        Slot& s = m_slots[slot];
+        m_owners[s.index] = npos;
+        s.index = npos;
+        s.generation++;
+        m_free.push_back(slot);
+        m_dead++;
+        if (!m_dispatching) settle();
+    }
+    bool empty() const { return m_owners.size() == m_dead; }
+    bool contains(uint32_t slot, uint32_t generation) const {
+        return slot < m_slots.size() && m_slots[slot].generation == generation && m_slots[slot].index != npos;
+    }
+
+   protected:
+    HookSlotsBase() = default;
+    HookSlotsBase(const HookSlotsBase& other)
+        : m_slots(other.m_slots), m_free(other.m_free), m_owners(other.m_owners), m_dead(other.m_dead) {}
+    // Copies like the copy constructor. The tokens of this list no longer refer to it, they would otherwise address
+    // the hooks of the other list. Refused while the list dispatches, the running dispatch would see other hooks.
+    HookSlotsBase& operator=(const HookSlotsBase& other) {
+        if (this == &other) return *this;
+        if (m_dispatching) throw std::logic_error("Hook list assigned during a dispatch");
+        auto slots = other.m_slots;
+        auto free = other.m_free;
+        auto owners = other.m_owners;
+        m_slots = std::move(slots);
+        m_free = std::move(free);
+        m_owners = std::move(owners);
+        m_dead = other.m_dead;
+        if (m_anchor) *std::exchange(m_anchor, nullptr) = nullptr;
+        return *this;
+    }
+    ~HookSlotsBase() {
+        if (m_anchor) *m_anchor = nullptr;
+    }
+
+    HookToken insert() {
+        uint32_t slot;
+        if (m_free.empty()) {
+            slot = (uint32_t) m_slots.size();
+            m_slots.push_back({});
+        } else {
+            slot = m_free.back();
+            m_free.pop_back();
+        }
+        m_slots[slot].index = (uint32_t) m_owners.size();
+        m_owners.push_back(slot);
+        if (!m_anchor) m_anchor = std::make_shared<HookSlotsBase*>(this);
+        return {m_anchor, slot, m_slots[slot].generation};
+    }
+    bool alive(size_t index) const { return m_owners[index] != npos; }
+    bool dispatching() const { return m_dispatching; }
+
+    // Removes dead entries from m_owners, calling move(from, to) for every surviving entry that moves down.
+    // Returns the new number of entries.
+    template <typename F> size_t compact(F&& move) {
+        size_t to = 0;
+        for (size_t from = 0; from < m_owners.size(); from++) {
+            if (m_owners[from] == npos) continue;
+            if (from != to) {
+                move(from, to);
+                m_owners[to] = m_owners[from];
+                m_slots[m_owners[to]].index = (uint32_t) to;
+            }
+            to++;
+        }
+        m_owners.resize(to);
+        m_dead = 0;
+        return to;
+    }
+    bool should_compact() const { return m_dead > 0 && m_dead * 2 >= m_owners.size(); }
+
+   private:
+    virtual void settle() = 0;
+    struct Slot {
+        uint32_t index = npos;
+        uint32_t generation = 0;
+    };
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free;
+    std::vector<uint32_t> m_owners;  // Entry index -> slot, npos for removed entries
+    size_t m_dead = 0;
+    int m_dispatching = 0;
+    HookToken::Anchor m_anchor;  // Shared with the tokens, created by the first insert, never copied or assigned
+};
+
+template <typename H> class HookSlots final : public HookSlotsBase {
+   public:
+    HookSlots() = default;
+    HookSlots(const HookSlots& other) : HookSlotsBase(other), m_hooks(other.m_hooks) {
+        m_hooks.insert(m_hooks.end(), other.m_pending.begin(), other.m_pending.end());
+    }
+    HookSlots& operator=(const HookSlots& other) {
+        if (this == &other) return *this;
+        auto hooks = other.m_hooks;
+        hooks.insert(hooks.end(), other.m_pending.begin(), other.m_pending.end());
+        HookSlotsBase::operator=(other);
+        m_hooks = std::move(hooks);
+        m_pending.clear();
+        return *this;
+    }
+    HookToken add(H hook) {
+        if (dispatching()) {
+            m_pending.push_back(std::move(hook));
+        } else {
+            m_hooks.push_back(std::move(hook));
+        }
+        return insert();
+    }
+    // Number of entries a dispatch should visit, including removed ones.
+    size_t size() const { return m_hooks.size(); }
+    // The hook at the given position, or nullptr if it has been removed.
+    H* get(size_t index) { return alive(index) ? &m_hooks[index] : nullptr; }
+    DispatchGuard dispatch() { return {*this}; }
+
+   private:
+    void settle() override {
+        for (auto& hook : m_pending) m_hooks.push_back(std::move(hook));
+        m_pending.clear();
+        if (should_compact()) {
+            m_hooks.erase(m_hooks.begin() + compact([this](size_t from, size_t to) {
+                              m_hooks[to] = std::move(m_hooks[from]);
+                          }),
+                          m_hooks.end());
+        }
+    }
+    std::vector<H> m_hooks;
+    std::vector<H> m_pending;
+};
+
+// Heap copy of the impl of a runtime observable. It stays empty in the classes that bind their impl statically, so
+// they do not carry a std::function. Copies copy the impl.
+template <typename F> class ImplBox {
+   public:
+    ImplBox() = default;
+    explicit ImplBox(F f) : m_f(std::make_unique<F>(std::move(f))) {}
+    ImplBox(const ImplBox& other) : m_f(other.m_f ? std::make_unique<F>(*other.m_f) : nullptr) {}
+    ImplBox(ImplBox&&) noexcept = default;
+    ImplBox& operator=(const ImplBox& other) { return *this = ImplBox(other); }
+    ImplBox& operator=(ImplBox&&) noexcept = default;
+    F& operator*() const { return *m_f; }
+
+   private:
+    std::unique_ptr<F> m_f;
+};
+
+}  // namespace detail
+
+inline void HookToken::unsubscribe() {
+    if (m_list && *m_list) (*m_list)->remove(m_slot, m_generation);
+    m_list.reset();
+}
+inline bool HookToken::subscribed() const { return m_list && *m_list && (*m_list)->contains(m_slot, m_generation); }
+
 }  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::HookToken;
+using promise::Subscription;
+#endif
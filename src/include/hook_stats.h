@@ -0,0 +1,344 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sharded_counters.h"
+
+namespace promise {
+class Coroutine;
+}
+
+// Per-hook call statistics for ObservablePromise and ObservableFunction.
+// Define PROMISE_HOOK_STATS (in every translation unit) to record them, otherwise all recording compiles away.
+namespace promise::stats {
+
+#ifdef PROMISE_HOOK_STATS
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// Name of an observable, its sites are named after it. Kept only while statistics are recorded. Observables created
+// without a name are numbered by kind, so their statistics are not merged with each other.
+#ifdef PROMISE_HOOK_STATS
+using Name = std::string;
+inline Name name_of(const char* name, const char* kind) {
+    static std::atomic<uint32_t> unnamed{};
+    if (*name) return name;
+    return std::string(kind) + "@" + std::to_string(unnamed.fetch_add(1, std::memory_order_relaxed));
+}
+#else
+struct Name {};
+inline Name name_of(const char*, const char*) { return {}; }
+#endif
+
+// Durations in nanoseconds, bucket k counts the durations d with bit_width(d) == k, i.e. d in [2^(k-1), 2^k).
+struct Histogram {
+    static constexpr size_t bucket_count = 65;
+    std::array<uint64_t, bucket_count> buckets{};
+
+    static size_t bucket(uint64_t ns) noexcept { return std::bit_width(ns); }
+    static uint64_t upper_bound(size_t bucket) noexcept {
+        return bucket >= 64 ? UINT64_MAX : (uint64_t{1} << bucket) - 1;
+    }
+    uint64_t count() const noexcept {
+        uint64_t total = 0;
+        for (auto b : buckets) total += b;
+        return total;
+    }
+    // Upper bound of the bucket that contains the given quantile, 0 if the histogram is empty.
+    uint64_t quantile(double q) const noexcept {
+        uint64_t total = count();
+        if (!total) return 0;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            seen += buckets[i];
+            if (seen && seen >= q * total) return upper_bound(i);
+        }
+        return upper_bound(bucket_count - 1);
+    }
+    Histogram& operator+=(const Histogram& other) noexcept {
+        for (size_t i = 0; i < bucket_count; i++) buckets[i] += other.buckets[i];
+        return *this;
+    }
+};
+
+struct SiteStats {
+    std::string name;
+    uint64_t calls = 0;
+    Histogram sync;       // Time until the call returned or suspended for the first time
+    Histogram suspended;  // Wall time between the first suspension and completion
+    SiteStats& operator+=(const SiteStats& other) {
+        calls += other.calls;
+        sync += other.sync;
+        suspended += other.suspended;
+        return *this;
+    }
+};
+
+namespace detail {
+
+using promise::detail::bump;
+using promise::detail::ShardedRegistry;
+
+// Slot of a site in the tables of the threads, and the generation of the slot it was given. Slots of removed sites are
+// reused under the next generation.
+struct SiteId {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+// Counters of one site on one thread.
+struct Counters {
+    explicit Counters(uint32_t generation) : generation(generation) {}
+    std::atomic<uint32_t> generation;  // Of the site the counts belong to
+    std::atomic<uint64_t> calls{};
+    std::array<std::atomic<uint64_t>, Histogram::bucket_count> sync{};
+    std::array<std::atomic<uint64_t>, Histogram::bucket_count> suspended{};
+
+    void clear() noexcept {
+        calls.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < Histogram::bucket_count; i++) {
+            sync[i].store(0, std::memory_order_relaxed);
+            suspended[i].store(0, std::memory_order_relaxed);
+        }
+    }
+    void add_to(SiteStats& stats) const noexcept {
+        stats.calls += calls.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < Histogram::bucket_count; i++) {
+            stats.sync.buckets[i] += sync[i].load(std::memory_order_relaxed);
+            stats.suspended.buckets[i] += suspended[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+// Slots of removed sites are reused, so the tables of the threads only grow up to the most sites alive at once.
+class Registry : public ShardedRegistry<Registry, Counters> {
+   public:
+    SiteId add(std::string name) {
+        std::lock_guard lock(m_mutex);
+        uint32_t slot;
+        if (m_free.empty()) {
+            slot = (uint32_t) m_generations.size();
+            m_generations.push_back(0);
+        } else {
+            slot = m_free.back();
+            m_free.pop_back();
+        }
+        m_names.emplace(slot, std::move(name));
+        return {slot, m_generations[slot]};
+    }
+    // The counters of the threads are zeroed and handed to the next generation of the slot instead of freed, a thread
+    // may still be recording into them. A Timing that finishes after its site is gone is dropped.
+    void remove(SiteId id) {
+        std::lock_guard lock(m_mutex);
+        m_names.erase(id.slot);
+        m_retired.erase(id.slot);
+        uint32_t next = ++m_generations[id.slot];
+        for_each_thread(id.slot, [&](Counters& counters) {
+            counters.clear();
+            counters.generation.store(next, std::memory_order_relaxed);
+        });
+        m_free.push_back(id.slot);
+    }
+    // Creates the counters of a site on the thread of shard, nullptr if the site has been removed meanwhile.
+    Counters* add_counters(Shard& shard, SiteId id) {
+        std::lock_guard lock(m_mutex);  // Orders this against remove()
+        if (id.slot >= m_generations.size() || m_generations[id.slot] != id.generation) return nullptr;
+        return &shard.emplace(id.slot, id.generation);
+    }
+    size_t capacity() {
+        std::lock_guard lock(m_mutex);
+        return m_generations.size();
+    }
+    std::string name(SiteId id) {
+        std::lock_guard lock(m_mutex);
+        return m_names[id.slot];
+    }
+    // Statistics of all living sites, sites with the same name are merged.
+    std::vector<SiteStats> snapshot() {
+        std::lock_guard lock(m_mutex);
+        std::map<std::string, SiteStats> merged;
+        for (auto& [slot, name] : m_names) {
+            SiteStats site;
+            if (auto it = m_retired.find(slot); it != m_retired.end()) site += it->second;
+            for_each_thread(slot, [&](const Counters& counters) { counters.add_to(site); });
+            merged[name] += site;
+        }
+        std::vector<SiteStats> result;
+        for (auto& [name, site] : merged) {
+            result.push_back(std::move(site));
+            result.back().name = name;
+        }
+        return result;
+    }
+
+   private:
+    friend class ShardedRegistry<Registry, Counters>;
+    // Keeps the counts of a finishing thread for the sites that are still alive.
+    void retire(const Shard& shard) {
+        shard.for_each([&](uint32_t slot, const Counters& counters) {
+            if (m_names.contains(slot)) counters.add_to(m_retired[slot]);
+        });
+    }
+    std::vector<uint32_t> m_generations;  // Current generation of every slot
+    std::vector<uint32_t> m_free;
+    std::map<uint32_t, std::string> m_names;
+    std::map<uint32_t, SiteStats> m_retired;
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+// The counters of the site on this thread, nullptr if the site has been removed or the thread is finishing.
+inline Counters* counters(SiteId id) {
+    auto shard = registry().local();
+    if (!shard) return nullptr;
+    auto counters = shard->find(id.slot);
+    if (counters && counters->generation.load(std::memory_order_relaxed) == id.generation) return counters;
+    return registry().add_counters(*shard, id);
+}
+
+inline uint64_t nanoseconds(Clock::duration d) {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+}  // namespace detail
+
+// A measured function: the impl of an observable or one of its hooks.
+class RecordingSite {
+   public:
+    explicit RecordingSite(std::string name) : m_id(detail::registry().add(std::move(name))) {}
+    RecordingSite(const std::string& owner, const char* kind, uint32_t index)
+        : RecordingSite(owner + "." + kind + "#" + std::to_string(index)) {}
+    RecordingSite(const RecordingSite& other)
+        : m_id(other.m_id.slot == npos ? other.m_id : detail::registry().add(detail::registry().name(other.m_id))) {}
+    RecordingSite(RecordingSite&& other) noexcept : m_id(std::exchange(other.m_id, {npos, 0})) {}
+    RecordingSite& operator=(RecordingSite other) noexcept {
+        std::swap(m_id, other.m_id);
+        return *this;
+    }
+    ~RecordingSite() {
+        if (m_id.slot != npos) detail::registry().remove(m_id);
+    }
+
+    // Records a synchronous call on destruction.
+    class Scope {
+       public:
+        Scope(detail::SiteId id) : m_id(id), m_start(Clock::now()) {}
+        Scope(const Scope&) = delete;
+        ~Scope() {
+            auto counters = detail::counters(m_id);
+            if (!counters) return;
+            detail::bump(counters->calls);
+            detail::bump(counters->sync[Histogram::bucket(detail::nanoseconds(Clock::now() - m_start))]);
+        }
+
+       private:
+        detail::SiteId m_id;
+        Clock::time_point m_start;
+    };
+    // Measures a Promise that was started by start(), finish() is called once it completed. A finish() after the site
+    // was destroyed is dropped.
+    class Timing {
+       public:
+        Timing() = default;
+        Timing(detail::SiteId id, Clock::time_point suspended) : m_id(id), m_suspended(suspended) {}
+        void finish() {
+            if (m_id.slot == npos) return;
+            auto counters = detail::counters(m_id);
+            if (!counters) return;
+            detail::bump(
+                counters->suspended[Histogram::bucket(detail::nanoseconds(Clock::now() - m_suspended))]);
+        }
+
+       private:
+        detail::SiteId m_id{npos, 0};
+        Clock::time_point m_suspended;
+    };
+
+    Scope time() const { return {m_id}; }
+    template <typename F, typename... A> decltype(auto) call(F& f, A&&... args) const {
+        Scope scope = time();
+        return f(std::forward<A>(args)...);
+    }
+    // Starts the promise, so its synchronous part can be timed separately from the time it spends suspended.
+    template <typename P> Timing start(P& promise) const {
+        auto begin = Clock::now();
+        promise->start();
+        auto end = Clock::now();
+        if (auto counters = detail::counters(m_id)) {
+            detail::bump(counters->calls);
+            detail::bump(counters->sync[Histogram::bucket(detail::nanoseconds(end - begin))]);
+        }
+        if (promise->done()) return {};
+        return {m_id, end};
+    }
+    // For a promise that caller awaits afterwards. It is awaited before it starts, so its synchronous part runs with the
+    // executor, priority and locals of the chain like it would without the statistics.
+    template <typename P> Timing start(P& promise, const Coroutine& caller) const {
+        promise->awaited_by(caller);
+        return start(promise);
+    }
+
+   private:
+    static constexpr uint32_t npos = UINT32_MAX;
+    detail::SiteId m_id;
+};
+
+// Stand-in for RecordingSite when statistics are disabled.
+class NullSite {
+   public:
+    explicit NullSite(const char*) {}
+    explicit NullSite(Name) {}
+    NullSite(Name, const char*, uint32_t) {}
+    struct Scope {};
+    struct Timing {
+        void finish() {}
+    };
+    Scope time() const { return {}; }
+    template <typename F, typename... A> decltype(auto) call(F& f, A&&... args) const {
+        return f(std::forward<A>(args)...);
+    }
+    template <typename P> Timing start(P&) const { return {}; }
+    template <typename P> Timing start(P&, const Coroutine&) const { return {}; }
+};
+
+#ifdef PROMISE_HOOK_STATS
+using Site = RecordingSite;
+#else
+using Site = NullSite;
+#endif
+
+// A hook together with the site that measures it.
+template <typename F> struct Measured {
+    F fn;
+    [[no_unique_address]] Site site;
+};
+
+inline std::vector<SiteStats> snapshot() { return detail::registry().snapshot(); }
+
+// Writes one line per observable: call count and the median, p99 and maximum of both histograms in ns.
+inline void dump(std::ostream& out) {
+    for (auto& site : snapshot()) {
+        out << site.name << " calls=" << site.calls << " sync_ns[p50=" << site.sync.quantile(0.5)
+            << " p99=" << site.sync.quantile(0.99) << " max=" << site.sync.quantile(1)
+            << "] suspended_ns[n=" << site.suspended.count() << " p50=" << site.suspended.quantile(0.5)
+            << " p99=" << site.suspended.quantile(0.99) << " max=" << site.suspended.quantile(1) << "]\n";
+    }
+}
+
+}  // namespace promise::stats
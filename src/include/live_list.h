@@ -0,0 +1,141 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Coroutine::living, the list of all live coroutines, exists in tests and when frame statistics or the live registry
+// (PROMISE_LIVE_REGISTRY, see backtrace.h) are enabled.
+#if defined(TEST) || defined(PROMISE_FRAME_STATS) || defined(PROMISE_LIVE_REGISTRY)
+#define PROMISE_TRACK_LIVING
+#endif
+
+namespace promise::detail {
+
+template <typename T> struct LiveSegment;
+
+// Links of an intrusive list of live objects, empty unless living objects are tracked.
+template <typename T> class LiveNode {
+#ifdef PROMISE_TRACK_LIVING
+   private:
+    template <typename> friend class LiveList;
+    T* m_live_prev{};
+    T* m_live_next{};
+    LiveSegment<T>* m_live_segment{};  // The segment it is linked into, nullptr while unlinked
+#endif
+};
+
+// The part of a LiveList that one thread links its objects into. Its mutex is only contended by threads that dump the
+// list or destroy an object of another thread.
+template <typename T> struct LiveSegment {
+    std::mutex mutex;
+    T* head{};
+    size_t size{};
+};
+
+// Intrusive list of the live objects of type T, which derives from LiveNode<T>. Unlike a hash set it does not
+// allocate on insertion. Every thread links into a segment of its own, like the shards of the statistics. The list
+// itself is only locked when a thread links its first object or exits, and to walk or count all objects. Segments of
+// finished threads are reused by the next thread, objects they still hold stay linked. There is one list per type.
+template <typename T> class LiveList {
+   public:
+    LiveList() = default;
+    LiveList(const LiveList&) = delete;
+
+    void insert(T* node) {
+        auto& segment = local();
+        std::lock_guard lock(segment.mutex);
+        node->m_live_prev = nullptr;
+        node->m_live_next = segment.head;
+        if (segment.head) segment.head->m_live_prev = node;
+        segment.head = node;
+        node->m_live_segment = &segment;
+        segment.size++;
+    }
+    void erase(T* node) {
+        auto segment = node->m_live_segment;
+        if (!segment) return;
+        std::lock_guard lock(segment->mutex);
+        if (node->m_live_prev) {
+            node->m_live_prev->m_live_next = node->m_live_next;
+        } else {
+            segment->head = node->m_live_next;
+        }
+        if (node->m_live_next) node->m_live_next->m_live_prev = node->m_live_prev;
+        unlink(node);
+        segment->size--;
+    }
+    bool contains(const T* node) const { return node->m_live_segment; }
+    size_t size() const {
+        size_t total = 0;
+        each_segment([&](LiveSegment<T>& segment) { total += segment.size; });
+        return total;
+    }
+    bool empty() const { return !size(); }
+    // Forgets all objects, they are not reported as leaked and may still be destroyed afterwards. Other threads must
+    // not destroy tracked objects meanwhile.
+    void clear() {
+        each_segment([](LiveSegment<T>& segment) {
+            for (T* node = segment.head; node;) {
+                T* next = node->m_live_next;
+                unlink(node);
+                node = next;
+            }
+            segment.head = nullptr;
+            segment.size = 0;
+        });
+    }
+    template <typename F> void for_each(F&& f) const {
+        each_segment([&](LiveSegment<T>& segment) {
+            for (const T* node = segment.head; node; node = node->m_live_next) f(*node);
+        });
+    }
+
+   private:
+    // Hands the segment of a thread back to the list when the thread exits.
+    struct Lease {
+        LiveList* list{};
+        LiveSegment<T>* segment{};
+        ~Lease() {
+            if (segment) list->release(segment);
+        }
+    };
+    LiveSegment<T>& local() {
+        thread_local Lease lease;
+        if (!lease.segment) {
+            lease.list = this;
+            lease.segment = acquire();
+        }
+        assert(lease.list == this);
+        return *lease.segment;
+    }
+    LiveSegment<T>* acquire() {
+        std::lock_guard lock(m_mutex);
+        if (m_free.empty()) return m_segments.emplace_back(std::make_unique<LiveSegment<T>>()).get();
+        auto segment = m_free.back();
+        m_free.pop_back();
+        return segment;
+    }
+    void release(LiveSegment<T>* segment) {
+        std::lock_guard lock(m_mutex);
+        m_free.push_back(segment);
+    }
+    template <typename F> void each_segment(F&& f) const {
+        std::lock_guard lock(m_mutex);
+        for (auto& segment : m_segments) {
+            std::lock_guard segment_lock(segment->mutex);
+            f(*segment);
+        }
+    }
+    static void unlink(T* node) {
+        node->m_live_prev = nullptr;
+        node->m_live_next = nullptr;
+        node->m_live_segment = nullptr;
+    }
+    mutable std::mutex m_mutex;  // Guards the segments, not the objects in them
+    std::vector<std::unique_ptr<LiveSegment<T>>> m_segments;
+    std::vector<LiveSegment<T>*> m_free;
+};
+
+}  // namespace promise::detail
@@ -0,0 +1,111 @@
+#pragma once
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "promise.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PROMISE_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace promise::io {
+
+// Read-only view of a whole file. It is memory-mapped for sequential access where the platform has mmap, elsewhere
+// the file is read into memory. Errors throw std::system_error.
+class MappedFile {
+   public:
+    explicit MappedFile(const std::string& path) {
+#ifdef PROMISE_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+        struct stat info;
+        if (fstat(fd, &info) != 0) fail(fd, path);
+        m_size = static_cast<size_t>(info.st_size);
+        if (m_size) {  // Mapping nothing is an error
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) fail(fd, path);
+            m_data = static_cast<const char*>(data);
+            madvise(data, m_size, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file) throw std::system_error(errno, std::generic_category(), path);
+        m_contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        m_data = m_contents.data();
+        m_size = m_contents.size();
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    ~MappedFile() {
+#ifdef PROMISE_HAS_MMAP
+        if (m_data) munmap(const_cast<char*>(m_data), m_size);
+#endif
+    }
+
+    std::string_view view() const noexcept { return {m_data, m_size}; }
+    size_t size() const noexcept { return m_size; }
+
+   private:
+#ifdef PROMISE_HAS_MMAP
+    [[noreturn]] static void fail(int fd, const std::string& path) {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+#else
+    std::string m_contents;
+#endif
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+namespace detail {
+// Takes the next line off text. memchr finds the delimiter, it scans many bytes per step.
+inline std::string_view take_line(std::string_view& text, char delimiter) {
+    auto found = static_cast<const char*>(std::memchr(text.data(), delimiter, text.size()));
+    size_t size = found ? found - text.data() : text.size();
+    std::string_view line = text.substr(0, size);
+    text.remove_prefix(found ? size + 1 : size);
+    return line;
+}
+}  // namespace detail
+
+// Yields the lines of text without their delimiter, a last line without one too. The views point into text and are
+// valid as long as it is, nothing is copied.
+inline Promise<void, std::string_view> lines(std::string_view text, char delimiter = '\n') {
+    while (!text.empty()) co_yield detail::take_line(text, delimiter);
+}
+// Yields data in records of record_size bytes, a shorter rest at the end too.
+inline Promise<void, std::string_view> records(std::string_view data, size_t record_size) {
+    assert(record_size > 0);
+    for (size_t offset = 0; offset < data.size(); offset += record_size) co_yield data.substr(offset, record_size);
+}
+
+// lines() and records() of the file at path, which stays mapped until the generator is destroyed, so the views are
+// valid as long as the generator lives. They scan the mapping directly instead of awaiting lines() and records(),
+// which would pass every element up through one more coroutine. Throws std::system_error on start if the file cannot
+// be opened.
+inline Promise<void, std::string_view> mapped_lines(std::string path, char delimiter = '\n') {
+    MappedFile file(path);
+    for (std::string_view text = file.view(); !text.empty();) co_yield detail::take_line(text, delimiter);
+}
+inline Promise<void, std::string_view> mapped_records(std::string path, size_t record_size) {
+    assert(record_size > 0);
+    MappedFile file(path);
+    std::string_view data = file.view();
+    for (size_t offset = 0; offset < data.size(); offset += record_size) co_yield data.substr(offset, record_size);
+}
+
+}  // namespace promise::io
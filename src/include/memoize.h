@@ -0,0 +1,157 @@
+#pragma once
+#include <exception>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "hook.h"
+#include "promise.h"
+
+namespace promise {
+
+// Decorator for the impl of an ObservablePromise: returns cached results for arguments it has seen before and lets
+// concurrent calls with the same arguments share a single call of the wrapped impl.
+// The cache keeps the `capacity` most recently used results. Arguments must be copyable and ordered by operator<.
+// Only the first caller sees the values yielded by the shared call. An exception of the shared call is rethrown to
+// every caller that joined it.
+template <typename R, typename Y, typename... Args> class Memoized {
+    static_assert(!std::is_void_v<R>, "Only functions that return a value can be memoized");
+
+   public:
+    using Impl = std::function<Promise<R, Y>(Args...)>;
+    using Key = std::tuple<std::decay_t<Args>...>;
+
+    Memoized(Impl impl, size_t capacity) : m_state(std::make_shared<State>(std::move(impl), capacity)) {}
+
+    Promise<R, Y> operator()(Args... args) {
+        auto state = m_state;
+        Key key{args...};
+        if (auto cached = state->lookup(key)) co_return *cached;
+        if (auto it = state->in_flight.find(key); it != state->in_flight.end()) {
+            Join join{it->second};
+            co_await join.point;
+            if (join.flight->error) std::rethrow_exception(join.flight->error);
+            if (!join.flight->result) throw std::runtime_error("Function did not return a value");
+            co_return *join.flight->result;
+        }
+        auto flight = std::make_shared<Flight>();
+        Landing landing{*state, key, flight};
+        try {
+            R result = co_await state->impl(std::forward<Args>(args)...);
+            state->insert(key, result);
+            flight->result = result;
+            co_return result;
+        } catch (...) {
+            flight->error = std::current_exception();  // Rethrown to everyone who joined, nothing is cached
+            throw;
+        }
+    }
+
+    size_t size() const { return m_state->lru.size(); }
+    size_t in_flight() const { return m_state->in_flight.size(); }
+    void clear() {
+        m_state->lru.clear();
+        m_state->cache.clear();
+    }
+
+   private:
+    struct Flight {
+        std::vector<SuspensionPoint<void>*> waiters;
+        optional<R> result;
+        std::exception_ptr error;
+    };
+    struct State {
+        State(Impl impl, size_t capacity) : impl(std::move(impl)), capacity(capacity) {}
+        Impl impl;
+        size_t capacity;
+        std::list<std::pair<Key, R>> lru;  // Most recently used first
+        std::map<Key, typename std::list<std::pair<Key, R>>::iterator> cache;
+        std::map<Key, std::shared_ptr<Flight>> in_flight;
+
+        const R* lookup(const Key& key) {
+            auto it = cache.find(key);
+            if (it == cache.end()) return nullptr;
+            lru.splice(lru.begin(), lru, it->second);
+            return &it->second->second;
+        }
+        void insert(const Key& key, const R& value) {
+            if (!capacity) return;
+            if (auto it = cache.find(key); it != cache.end()) {
+                it->second->second = value;
+                lru.splice(lru.begin(), lru, it->second);
+                return;
+            }
+            if (lru.size() >= capacity) {
+                cache.erase(lru.back().first);
+                lru.pop_back();
+            }
+            lru.emplace_front(key, value);
+            cache.emplace(key, lru.begin());
+        }
+    };
+    // Registers the shared call while it runs and wakes up everyone who joined it once it is over, also when the
+    // leading call is destroyed before it finished.
+    struct Landing {
+        State& state;
+        const Key& key;
+        std::shared_ptr<Flight> flight;
+        Landing(State& state, const Key& key, std::shared_ptr<Flight> f) : state(state), key(key), flight(f) {
+            state.in_flight.emplace(key, flight);
+        }
+        Landing(const Landing&) = delete;
+        ~Landing() {
+            state.in_flight.erase(key);
+            // One at a time, a waiter that goes away while the others are woken up removes itself
+            while (!flight->waiters.empty()) {
+                auto waiter = flight->waiters.front();
+                flight->waiters.erase(flight->waiters.begin());
+                waiter->resume();
+            }
+        }
+    };
+    // Waits for a shared call that another caller leads. The waiter is unregistered when the caller is destroyed
+    // before the call landed, so the Landing never resumes a dead frame.
+    struct Join {
+        std::shared_ptr<Flight> flight;
+        SuspensionPoint<void> point;
+        Join(std::shared_ptr<Flight> f) : flight(std::move(f)) { flight->waiters.push_back(&point); }
+        Join(const Join&) = delete;
+        ~Join() { std::erase(flight->waiters, &point); }
+    };
+    std::shared_ptr<State> m_state;
+};
+
+template <typename R, typename Y, typename... Args>
+Memoized<R, Y, Args...> memoize(std::type_identity_t<std::function<Promise<R, Y>(Args...)>> impl, size_t capacity) {
+    return {std::move(impl), capacity};
+}
+
+// HOOK whose impl is memoized with the given cache capacity. Hooks still run on every call.
+#define MEMOIZED_HOOK(result, yield, Parent, name, capacity, ...)                                        \
+    class name : public promise::BasicObservablePromise<name, result, yield __VA_OPT__(, __VA_ARGS__)> { \
+        Parent* self;                                                                                    \
+        Promise<result, yield> impl(__VA_ARGS__);                                                        \
+        promise::Memoized<result, yield __VA_OPT__(, __VA_ARGS__)> memoized;                             \
+        template <typename... A> Promise<result, yield> call_impl(A&&... args) {                         \
+            return memoized(std::forward<A>(args)...);                                                   \
+        }                                                                                                \
+        name(Parent* p)                                                                                  \
+            : promise::BasicObservablePromise<name, result, yield __VA_OPT__(, __VA_ARGS__)>(            \
+                  #Parent "::" #name),                                                                   \
+              self(p),                                                                                   \
+              memoized(promise::bind_member(&name::impl, this), capacity) {}                             \
+        friend class promise::BasicObservablePromise<name, result, yield __VA_OPT__(, __VA_ARGS__)>;     \
+        friend class Parent;                                                                             \
+    } name{this};                                                                                        \
+    friend class name
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::Memoized;
+#endif
@@ -1,4 +1,5 @@
 #pragma once
+#include <new>
 #include <optional>
 #include <type_traits>
 
@@ -19,17 +20,46 @@ template <typename T> using optional = detail::optional_helper<T>::type;
 
 namespace detail {
 
-template <typename T, typename Ref> class inplace_optional;
+template <typename T> class inplace_optional;
+template <typename T> class trivial_optional;
+template <typename T> class reference_optional;
 class optional_void;
 
 template <typename T> struct is_optional : public std::bool_constant<false> {};
 template <typename T> constexpr bool is_optional_v = is_optional<T>::value;
 
 template <typename T> struct is_optional<std::optional<T>> : public std::bool_constant<true> {};
-template <typename T, typename R> struct is_optional<inplace_optional<T, R>> : public std::bool_constant<true> {};
+template <typename T> struct is_optional<inplace_optional<T>> : public std::bool_constant<true> {};
+template <typename T> struct is_optional<trivial_optional<T>> : public std::bool_constant<true> {};
+template <typename T> struct is_optional<reference_optional<T>> : public std::bool_constant<true> {};
 template <> struct is_optional<optional_void> : public std::bool_constant<true> {};
 
-template <typename T, typename Ref = T> class inplace_optional {
+// Comparisons shared by the optionals below
+template <typename Derived> class optional_compare {
+   public:
+    template <typename S>
+    bool operator==(const S& other) const
+        requires(is_optional_v<S>)
+    {
+        const Derived& self = static_cast<const Derived&>(*this);
+        if (self.has_value() && other.has_value()) return *self == *other;
+        return self.has_value() == other.has_value();
+    }
+    template <typename S>
+    bool operator==(const S& other) const
+        requires(!is_optional_v<S>)
+    {
+        const Derived& self = static_cast<const Derived&>(*this);
+        if (self.has_value()) return *self == other;
+        return false;
+    }
+};
+
+template <typename T, typename Self>
+concept not_same_optional = !std::is_same_v<std::remove_cvref_t<T>, Self>;
+
+// Optional for types that can only be constructed, not assigned
+template <typename T> class inplace_optional : public optional_compare<inplace_optional<T>> {
    public:
     struct Dummy {
         constexpr Dummy() noexcept {}
@@ -57,23 +87,24 @@ template <typename T, typename Ref = T> class inplace_optional {
         requires(sizeof...(Args) > 0)
         : m_value(std::forward<Args>(args)...), m_has_value(true) {}
     ~inplace_optional() { destroy(); }
-    Ref& operator*() & { return m_value; }
-    Ref* operator->() { return &m_value; }
-    const Ref& operator*() const& { return m_value; }
-    const Ref* operator->() const { return &m_value; }
-    Ref&& operator*() && { return std::move(m_value); }
+    T& operator*() & { return m_value; }
+    T* operator->() { return &m_value; }
+    const T& operator*() const& { return m_value; }
+    const T* operator->() const { return &m_value; }
+    T&& operator*() && { return std::move(m_value); }
     template <typename... Args> void assign(Args&&... args) {
         reset();
         new (&m_value) T(std::forward<Args>(args)...);
         m_has_value = true;
     }
-    template <typename Arg> inplace_optional& operator=(Arg&& arg) && {
+    template <not_same_optional<inplace_optional> Arg> inplace_optional& operator=(Arg&& arg) && {
         assign(std::forward<Arg>(arg));
         return *this;
     }
     inplace_optional& operator=(inplace_optional&& other) {
+        if (this == &other) return *this;
         if (other) {
-            assign(other.m_value);
+            assign(std::move(other.m_value));
         } else {
             reset();
         }
@@ -84,25 +115,68 @@ template <typename T, typename Ref = T> class inplace_optional {
         destroy();
         m_has_value = false;
     }
-    template <typename S>
-    bool operator==(const S& other) const
-        requires(is_optional_v<S>)
-    {
-        if (has_value() && other.has_value()) return **this == *other;
-        return has_value() == other.has_value();
+
+   private:
+    void destroy() {
+        if (m_has_value) m_value.~T();
     }
-    template <typename S>
-    bool operator==(const S& other) const
-        requires(!is_optional_v<S>)
+};
+
+// Optional for trivially copyable types that cannot be assigned. Copying the raw storage copies the value, so the
+// optional itself stays trivially copyable.
+template <typename T> class trivial_optional : public optional_compare<trivial_optional<T>> {
+   public:
+    trivial_optional() = default;
+    template <typename... Args>
+    explicit trivial_optional(Args&&... args)
+        requires(sizeof...(Args) > 0)
     {
-        if (has_value()) return **this == other;
-        return false;
+        assign(std::forward<Args>(args)...);
     }
+    explicit operator bool() const noexcept { return m_has_value; }
+    bool operator!() const noexcept { return !m_has_value; }
+    T& operator*() & { return *value(); }
+    T* operator->() { return value(); }
+    const T& operator*() const& { return *value(); }
+    const T* operator->() const { return value(); }
+    T&& operator*() && { return std::move(*value()); }
+    template <typename... Args> void assign(Args&&... args) {
+        new (m_storage) T(std::forward<Args>(args)...);
+        m_has_value = true;
+    }
+    template <not_same_optional<trivial_optional> Arg> trivial_optional& operator=(Arg&& arg) && {
+        assign(std::forward<Arg>(arg));
+        return *this;
+    }
+    bool has_value() const noexcept { return m_has_value; }
+    void reset() noexcept { m_has_value = false; }
 
    private:
-    void destroy() {
-        if (m_has_value) m_value.~T();
+    T* value() noexcept { return std::launder(reinterpret_cast<T*>(m_storage)); }
+    const T* value() const noexcept { return std::launder(reinterpret_cast<const T*>(m_storage)); }
+    alignas(T) unsigned char m_storage[sizeof(T)];
+    bool m_has_value = false;
+};
+
+// Optional reference, the null pointer marks the empty state.
+template <typename T> class reference_optional : public optional_compare<reference_optional<T>> {
+   public:
+    reference_optional() = default;
+    explicit reference_optional(T& ref) noexcept : m_ref(&ref) {}
+    explicit operator bool() const noexcept { return m_ref; }
+    bool operator!() const noexcept { return !m_ref; }
+    T& operator*() const noexcept { return *m_ref; }
+    T* operator->() const noexcept { return m_ref; }
+    void assign(T& ref) noexcept { m_ref = &ref; }
+    reference_optional& operator=(T& ref) && noexcept {
+        assign(ref);
+        return *this;
     }
+    bool has_value() const noexcept { return m_ref; }
+    void reset() noexcept { m_ref = nullptr; }
+
+   private:
+    T* m_ref = nullptr;
 };
 
 class optional_void {
@@ -116,10 +190,6 @@ class optional_void {
     optional_void() : m_has_value(false) {}
     explicit optional_void(bool filled) : m_has_value(filled) {}
     void set() { m_has_value = true; }
-    optional_void& operator=(const optional_void& other) {
-        m_has_value = other.has_value();
-        return *this;
-    }
     bool operator==(const optional_void& other) const noexcept = default;
     auto operator<=>(const optional_void& other) const noexcept = default;
     template <typename S>
@@ -134,15 +204,10 @@ class optional_void {
 };
 
 template <is_not_assignable T> struct optional_helper<T> {
-    using type = inplace_optional<T>;
+    using type = std::conditional_t<std::is_trivially_copyable_v<T>, trivial_optional<T>, inplace_optional<T>>;
 };
 template <typename T> struct optional_helper<T&> {
-    struct Reference {
-        T& ref;
-        operator T&() { return ref; }
-        operator const T&() const { return ref; }
-    };
-    using type = inplace_optional<Reference, T>;
+    using type = reference_optional<T>;
 };
 template <> struct optional_helper<void> {
     using type = optional_void;
@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <ranges>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "promise.h"
+#include "thread_pool.h"
+
+namespace promise {
+
+namespace detail {
+
+// Result of applying fn to an element, for coroutines the value they return
+template <typename Range, typename Fn>
+using map_result_t = awaited_result_t<std::invoke_result_t<Fn&, std::ranges::range_reference_t<Range>>>;
+
+inline Promise<void> notify(SuspensionPoint<void>& point) {
+    point.resume();
+    co_return;
+}
+
+template <typename R> struct MapState {
+    explicit MapState(size_t size) : results(size), notifier(notify(finished)) {}
+    std::vector<optional<R>> results;
+    std::atomic<size_t> next{};
+    std::atomic<size_t> running{};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    Executor* home{};
+    SuspensionPoint<void> finished;
+    Promise<void> notifier;  // Bound to home, resumes the caller there
+    void fail(std::exception_ptr e) {
+        {
+            std::lock_guard lock(error_mutex);
+            if (!error) error = e;
+        }
+        next.store(results.size(), std::memory_order_relaxed);  // Elements that did not start are skipped
+    }
+};
+
+// Takes the next element until all are taken, so max_parallelism workers share the range. Every worker calls its own
+// copy of fn.
+template <typename R, typename Range, typename Fn> Promise<void> map_worker(MapState<R>& state, Range& range, Fn fn) {
+    for (;;) {
+        size_t i = state.next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= state.results.size()) break;
+        try {
+            auto&& element = std::ranges::begin(range)[i];
+            if constexpr (is_promise<std::invoke_result_t<Fn&, decltype(element)>>) {
+                state.results[i] = co_await std::invoke(fn, element);
+            } else {
+                state.results[i] = std::invoke(fn, element);
+            }
+        } catch (...) {
+            state.fail(std::current_exception());
+        }
+    }
+    if (state.running.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        state.home->post(state.notifier, state.notifier->priority());
+    }
+}
+
+}  // namespace detail
+
+// Applies fn to every element on the threads of pool and returns the results in order. At most max_parallelism
+// elements run at once, 0 means one per pool thread. fn returns a value or a Promise<R> whose value is taken. Every
+// worker gets a copy of fn, so its own state needs no locking, but whatever the copies share by reference is used
+// from several threads at once.
+// The awaiting coroutine must be bound to a single threaded executor like an EventLoop, it continues there once all
+// elements are done. The first exception is rethrown after the running elements finished.
+template <std::ranges::random_access_range Range, typename Fn>
+    requires std::ranges::sized_range<Range>
+Promise<std::vector<detail::map_result_t<Range, Fn>>> parallel_map(ThreadPool& pool, Range& range, Fn fn,
+                                                                   size_t max_parallelism = 0) {
+    using R = detail::map_result_t<Range, Fn>;
+    static_assert(!std::is_void_v<R>, "parallel_map needs a result per element");
+    Coroutine& self = co_await this_coroutine;
+    if (!self.executor()) throw std::logic_error("parallel_map needs a coroutine bound to an executor");
+    detail::MapState<R> state(std::ranges::size(range));
+    size_t workers = std::min(max_parallelism ? max_parallelism : pool.threads(), state.results.size());
+    if (workers) {
+        state.home = self.executor();
+        state.notifier->waited_for_by(self);
+        state.running.store(workers, std::memory_order_relaxed);
+        for (size_t i = 0; i < workers; i++) {
+            auto worker = detail::map_worker(state, range, fn);
+            worker->set_executor(&pool);
+            worker->inherit(self);
+            pool.post(worker, worker->priority());
+        }
+        co_await state.finished;
+    }
+    if (state.error) std::rethrow_exception(state.error);
+    std::vector<R> results;
+    results.reserve(state.results.size());
+    for (auto& result : state.results) results.push_back(std::move(*result));
+    co_return results;
+}
+template <std::ranges::random_access_range Range, typename Fn>
+    requires std::ranges::sized_range<Range>
+Promise<std::vector<detail::map_result_t<Range, Fn>>> parallel_map(Range& range, Fn fn, size_t max_parallelism = 0) {
+    return parallel_map(default_pool(), range, std::move(fn), max_parallelism);
+}
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::parallel_map;
+#endif
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "promise.h"
+
+namespace promise {
+
+namespace detail {
+
+// Stages of a pipeline. Each one takes an element and gives an optional one, an empty one drops the element.
+template <typename F> struct Transform {
+    F fn;
+    template <typename T> auto operator()(T&& value) {
+        return optional<std::decay_t<std::invoke_result_t<F&, T&&>>>(std::invoke(fn, std::forward<T>(value)));
+    }
+    bool exhausted() const noexcept { return false; }
+};
+template <typename P> struct Filter {
+    P predicate;
+    template <typename T> optional<std::decay_t<T>> operator()(T&& value) {
+        if (!std::invoke(predicate, std::as_const(value))) return {};
+        return optional<std::decay_t<T>>(std::forward<T>(value));
+    }
+    bool exhausted() const noexcept { return false; }
+};
+struct Take {
+    size_t left;
+    template <typename T> optional<std::decay_t<T>> operator()(T&& value) {
+        left--;
+        return optional<std::decay_t<T>>(std::forward<T>(value));
+    }
+    // The source is not pulled again once the last element passed
+    bool exhausted() const noexcept { return !left; }
+};
+
+template <typename T> constexpr bool is_stage = false;
+template <typename F> constexpr bool is_stage<Transform<F>> = true;
+template <typename P> constexpr bool is_stage<Filter<P>> = true;
+template <> constexpr bool is_stage<Take> = true;
+
+template <size_t I, typename Stages, typename T> auto apply_stages(Stages& stages, T&& value) {
+    if constexpr (I == std::tuple_size_v<Stages>) {
+        return optional<std::decay_t<T>>(std::forward<T>(value));
+    } else {
+        auto result = std::get<I>(stages)(std::forward<T>(value));
+        using Out = decltype(apply_stages<I + 1>(stages, std::move(*result)));
+        if (!result) return Out();
+        return apply_stages<I + 1>(stages, std::move(*result));
+    }
+}
+template <typename Y, typename Stages> using pipeline_output_t =
+    std::decay_t<decltype(*apply_stages<0>(std::declval<Stages&>(), std::declval<Y>()))>;
+
+template <typename Stages> bool stages_exhausted(const Stages& stages) {
+    return std::apply([](const auto&... stage) { return (stage.exhausted() || ...); }, stages);
+}
+
+// Runs the stages inside the co_yield of the source and yields what comes out of them from the pipeline coroutine.
+template <typename Y, typename Stages> class StageSink final : public YieldSink<Y> {
+   public:
+    using Out = pipeline_output_t<Y, Stages>;
+    StageSink(Stages stages, YieldingCoroutine<Out>& pipeline) : m_stages(std::move(stages)), m_pipeline(pipeline) {}
+    bool push(optional<Y>& value) override {
+        if (!value) return true;  // A yield of nothing is passed on as it is
+        auto out = apply_stages<0>(m_stages, std::move(*value));
+        if (!out) return false;
+        m_pipeline.yield_value(std::move(*out));
+        return true;
+    }
+    bool exhausted() const noexcept override { return stages_exhausted(m_stages); }
+
+   private:
+    Stages m_stages;
+    YieldingCoroutine<Out>& m_pipeline;
+};
+
+// The stages run in the frame of the source, only the source is resumed for an element and dropped elements never
+// leave it. The pipeline coroutine hands the elements on like a coroutine that awaits a generator, its own frame only
+// runs at the start and the end, however many stages there are.
+template <typename R, typename Y, typename Stages>
+Promise<void, pipeline_output_t<Y, Stages>> fused(Promise<R, Y> source, Stages stages) {
+    if (stages_exhausted(stages)) co_return;
+    auto& self = static_cast<YieldingCoroutine<pipeline_output_t<Y, Stages>>&>(co_await this_coroutine);
+    StageSink<Y, Stages> sink(std::move(stages), self);
+    co_await Sink<R, Y>{source, sink};
+}
+
+}  // namespace detail
+
+// A generator with stages attached by operator|, which run inside the co_yield of the source instead of in a generator
+// per stage. Assign it to a Promise to run it:
+// Promise<void, int> squares = numbers() | transform(square) | filter(even) | take(10);
+template <typename R, typename Y, typename... Stages> class Pipeline {
+   public:
+    using value_type = detail::pipeline_output_t<Y, std::tuple<Stages...>>;
+
+    Pipeline(Promise<R, Y> source, std::tuple<Stages...> stages)
+        : m_source(std::move(source)), m_stages(std::move(stages)) {}
+    operator Promise<void, value_type>() && { return detail::fused(std::move(m_source), std::move(m_stages)); }
+
+    template <typename Stage>
+        requires detail::is_stage<Stage>
+    friend Pipeline<R, Y, Stages..., Stage> operator|(Pipeline&& pipeline, Stage stage) {
+        auto stages = std::tuple_cat(std::move(pipeline.m_stages), std::tuple(std::move(stage)));
+        return {std::move(pipeline.m_source), std::move(stages)};
+    }
+
+   private:
+    Promise<R, Y> m_source;
+    std::tuple<Stages...> m_stages;
+};
+
+template <typename R, typename Y, typename Stage>
+    requires detail::is_stage<Stage>
+Pipeline<R, Y, Stage> operator|(Promise<R, Y> source, Stage stage) {
+    return {std::move(source), std::tuple(std::move(stage))};
+}
+
+// Applies fn to every element.
+template <typename F> detail::Transform<F> transform(F fn) { return {std::move(fn)}; }
+// Keeps the elements for which predicate returns true.
+template <typename P> detail::Filter<P> filter(P predicate) { return {std::move(predicate)}; }
+// Ends the pipeline after n elements.
+inline detail::Take take(size_t n) { return {n}; }
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::Pipeline;
+#endif
@@ -1,41 +1,165 @@
 #pragma once
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <concepts>
 #include <coroutine>
-#include <functional>
+#include <cstdint>
+#include <exception>
+#include <memory>
 #include <stdexcept>
+#include <source_location>
 #include <type_traits>
-#include <unordered_set>
+#include <utility>
 
+#include "coroutine_local.h"
+#include "frame_pool.h"
+#include "frame_stats.h"
+#include "live_list.h"
 #include "optional.h"
+#include "trace.h"
+
+// Define PROMISE_THREADS (in every translation unit) to resume coroutines on other threads, like ThreadPool does.
+// Handles then count their references atomically, which single threaded programs do not need to pay for.
+#if defined(TEST) && !defined(PROMISE_THREADS)
+#define PROMISE_THREADS
+#endif
 
 namespace promise {
 
 template <typename T> class SuspensionPoint;
+template <typename T> class AtomicSuspensionPoint;
 template <typename R, typename Y> class Promise;
 
 struct YieldNothing {
     explicit YieldNothing() = default;
 } const nothing;
 
+// co_await yield_now() gives the thread to the other coroutines of the executor, the coroutine is queued again.
+struct YieldNow {};
+inline YieldNow yield_now() noexcept { return {}; }
+// co_await this_coroutine gives the Coroutine that is running, for example to let a started coroutine inherit from it.
+struct ThisCoroutine {
+    explicit ThisCoroutine() = default;
+} const this_coroutine;
+
 namespace detail {
 class WaitObject;
+class DeferredWait;
+class Migration;
+class Requeue;
+class RemoteQueue;
+// What a ForwardYield did with the value of the callee: the caller yields it, dropped it so the callee has to go on,
+// or yields it as its last one so the callee is not resumed again.
+enum class Forwarded : uint8_t { passed, dropped, last };
+// What few coroutines need, allocated on first use: the exception it threw and the locals it set.
+struct ColdState {
+    std::exception_ptr exception;
+    Locals locals;
+};
+}  // namespace detail
+namespace backtrace::detail {
+struct Access;
 }
+class Executor;
+
+// co_await resume_on(executor) suspends the whole await chain and continues it on the executor, which the chain is
+// bound to from then on. Moving to another thread needs PROMISE_THREADS.
+struct ResumeOn {
+    Executor& executor;
+};
+inline ResumeOn resume_on(Executor& executor) noexcept { return {executor}; }
+
+// Scheduling class of a coroutine, executors run the resumptions of higher priorities first.
+enum class Priority : uint8_t { high, normal, background };
+constexpr size_t priority_count = 3;
 
-class Coroutine {
+class Coroutine : public detail::LiveNode<Coroutine> {
    public:
-    Coroutine();
+    explicit Coroutine(const std::source_location& loc);
     ~Coroutine();
-    bool done() const noexcept { return m_handle.done(); }
+#ifdef PROMISE_FRAME_STATS
+    static void* operator new(size_t size, std::source_location loc = std::source_location::current()) {
+        return frames::detail::allocate(size, loc);
+    }
+    static void operator delete(void* frame, size_t size) { frames::detail::deallocate(frame, size); }
+#else
+    static void* operator new(size_t size) { return detail::allocate_frame(size); }
+    static void operator delete(void* frame, size_t size) { detail::free_frame(frame, size); }
+#endif
+    bool done() const noexcept { return handle().done(); }
     bool started() const noexcept { return m_started; }
     bool yielded() const noexcept { return m_yielded; }
     void start();
+    void start(Priority priority) {
+        set_priority(priority);
+        start();
+    }
     void resume();
+    // Resumptions through a SuspensionPoint are posted to the executor instead of running inline. Coroutines that
+    // are awaited inherit the executor of their caller.
+    Executor* executor() const noexcept { return m_executor; }
+    void set_executor(Executor* executor) noexcept { m_executor = executor; }
+    // Awaited coroutines inherit the priority of their caller unless it was set explicitly.
+    Priority priority() const noexcept { return static_cast<Priority>(m_priority); }
+    void set_priority(Priority priority) noexcept {
+        m_priority = static_cast<uint8_t>(priority);
+        m_priority_set = true;
+    }
+    // Called when caller awaits this coroutine, only the root of an await chain is not awaited.
+    void awaited_by(const Coroutine& caller) noexcept {
+        m_awaited = true;
+        waited_for_by(caller);
+    }
+    // Like awaited_by for coroutines that caller waits for without awaiting them. They see the locals of caller.
+    void waited_for_by(const Coroutine& caller) noexcept {
+        inherit_scheduling(caller);
+        if (!m_locals) m_locals = caller.m_locals;
+    }
+    // For coroutines that run on their own, on this thread or another one: takes the executor and priority of parent
+    // and a copy of its locals.
+    void inherit(const Coroutine& parent) {
+        inherit_scheduling(parent);
+        if (!m_locals && parent.m_locals) m_locals = own_locals(*parent.m_locals);
+    }
+    // Coroutine local values, see coroutine_local.h. Setting one before the coroutine starts sets it for the chain.
+    template <typename T> T* get(const Local<T>& key) const noexcept {
+        return m_locals ? m_locals->get<T>(key.index()) : nullptr;
+    }
+    template <typename T> T& set(const Local<T>& key, T value) {
+        if (!m_cold || m_locals != &m_cold->locals) m_locals = own_locals(m_locals ? *m_locals : detail::Locals());
+        return m_locals->set(key.index(), std::move(value));
+    }
 
     std::suspend_always initial_suspend() const noexcept { return {}; }
-    std::suspend_always final_suspend() const noexcept { return {}; }
-    void unhandled_exception() {}
+    std::suspend_always final_suspend() const noexcept {
+        trace::done(this);
+        return {};
+    }
+    // The exception is rethrown in the coroutine that awaits this one.
+    void unhandled_exception() noexcept { cold().exception = std::current_exception(); }
+    std::exception_ptr exception() const noexcept { return m_cold ? m_cold->exception : nullptr; }
     template <typename T> auto await_transform(SuspensionPoint<T>& s);
+    template <typename T> auto await_transform(AtomicSuspensionPoint<T>& s);
+    template <typename T> struct ReadyAwaiter {
+        T result;
+        bool await_ready() const noexcept { return true; }
+        void await_suspend(auto) const noexcept {}
+        T await_resume() const noexcept { return result; }
+    };
+    struct YieldAwaiter {
+        Coroutine& coroutine;
+        bool await_ready() const noexcept { return !coroutine.m_executor; }
+        bool await_suspend(std::coroutine_handle<>);
+        void await_resume() {}
+    };
+    YieldAwaiter await_transform(YieldNow) { return {*this}; }
+    detail::Migration await_transform(ResumeOn target);
+    ReadyAwaiter<Coroutine&> await_transform(const ThisCoroutine&) { return {*this}; }
+    template <typename T> auto await_transform(const Local<T>& key) { return ReadyAwaiter<T*>{get(key)}; }
+    template <typename T> auto await_transform(detail::LocalSet<T>&& s) {
+        return ReadyAwaiter<T&>{set(s.key, std::move(s.value))};
+    }
 
     class Handle {
        public:
@@ -50,27 +174,114 @@ class Coroutine {
     };
 
    protected:
+    // Passes the value that callee yielded on to caller, nullptr for callers that yield no values.
+    using ForwardYield = detail::Forwarded (*)(Coroutine& caller, Coroutine& callee);
     bool wait_for_calling();
-    bool m_yielded = false;
-    bool m_started = false;
-    struct YieldingHandle {
-        Handle handle;
-        std::function<void()> update_yield_value;
-    };
-    optional<YieldingHandle> calling{};
-    detail::WaitObject* m_wait_object{};
+    void call(Coroutine& callee, ForwardYield forward, bool pulled) noexcept {
+        callee.gain_ref();
+        m_calling = &callee;
+        m_forward_yield = forward;
+        m_pulled = pulled;
+    }
+    void stop_calling() noexcept { std::exchange(m_calling, nullptr)->lose_ref(); }
+    void suspending() noexcept {
+#ifdef PROMISE_TRACK_LIVING
+        m_suspended_at = std::chrono::steady_clock::now();
+#endif
+    }
+    void yield_nothing() noexcept {
+        m_yielded = true;
+        suspending();
+        trace::yielded(this);
+    }
+    // The flags, the priority and the reference count share one word
+    bool m_yielded : 1 = false;
+    bool m_started : 1 = false;
+    bool m_priority_set : 1 = false;
+    bool m_awaited : 1 = false;
+    bool m_pulled : 1 = false;  // Yields of the callee go to this coroutine instead of up the chain, see pull()
+    uint8_t m_priority : 2 = static_cast<uint8_t>(Priority::normal);
 
    private:
+    friend class detail::DeferredWait;
+    void inherit_scheduling(const Coroutine& parent) noexcept {
+        if (!m_executor) m_executor = parent.m_executor;
+        if (!m_priority_set) m_priority = parent.m_priority;
+    }
+    detail::ColdState& cold() {
+        if (!m_cold) m_cold = std::make_unique<detail::ColdState>();
+        return *m_cold;
+    }
+    detail::Locals* own_locals(const detail::Locals& from) {
+        auto& locals = cold().locals;
+        locals = from;
+        return &locals;
+    }
     void gain_ref();
     void lose_ref();
-    std::coroutine_handle<Coroutine> m_handle;
-    int m_ref_count = 0;
-#ifdef TEST
+    std::coroutine_handle<Coroutine> handle() const noexcept {
+        return std::coroutine_handle<Coroutine>::from_promise(const_cast<Coroutine&>(*this));
+    }
+#ifdef PROMISE_THREADS
+    friend class detail::RemoteQueue;
+    Priority m_remote_priority = Priority::normal;
+    std::atomic<uint32_t> m_ref_count = 0;
+#else
+    uint32_t m_ref_count = 0;
+#endif
+
+   protected:
+    Coroutine* m_calling{};  // The coroutine this one awaits or pulls from, holds a reference
+    ForwardYield m_forward_yield{};
+    detail::WaitObject* m_wait_object{};
+    Executor* m_executor{};
+    detail::Locals* m_locals{};  // Owned by this coroutine or one that waits for it
+    std::unique_ptr<detail::ColdState> m_cold;
+
+   private:
+#ifdef PROMISE_THREADS
+    Coroutine* m_remote_next{};  // Link while queued for an EventLoop of another thread
+#endif
+#ifdef PROMISE_TRACK_LIVING
+    friend struct backtrace::detail::Access;
+    const char* m_function;
+    std::chrono::steady_clock::time_point m_suspended_at{};
+
    public:
-    inline static std::unordered_set<const Coroutine*> living = {};
+    inline static detail::LiveList<Coroutine> living;
 #endif
 };
 
+// What every frame pays for its Coroutine on 64 bit targets: a word of flags and reference count, the callee with the
+// function that forwards its yields, the wait object, the executor, the visible locals and the cold state. Threads add
+// the link of the remote queue, tracking the links of the live list, the function name and the suspension time.
+#if defined(PROMISE_THREADS) && defined(PROMISE_TRACK_LIVING)
+static_assert(sizeof(void*) != 8 || sizeof(Coroutine) == 104, "Coroutine header changed size");
+#elif defined(PROMISE_TRACK_LIVING)
+static_assert(sizeof(void*) != 8 || sizeof(Coroutine) == 96, "Coroutine header changed size");
+#elif defined(PROMISE_THREADS)
+static_assert(sizeof(void*) != 8 || sizeof(Coroutine) == 64, "Coroutine header changed size");
+#else
+static_assert(sizeof(void*) != 8 || sizeof(Coroutine) == 56, "Coroutine header changed size");
+#endif
+
+// Runs the resumptions of the coroutines bound to it, see EventLoop.
+class Executor {
+   public:
+    // The priority is the one of the coroutine that suspended, which can be a callee of the posted root.
+    virtual void post(Coroutine::Handle handle, Priority priority) = 0;
+    // Time slicing. Awaiting a coroutine that finishes without suspending spends one unit of the budget of the running
+    // resumption, the awaiting coroutine yields once it is used up.
+    virtual bool spend_budget() noexcept { return false; }
+    // Asks to queue the chain of coroutine, which is suspending, again once the root of the chain suspended. That
+    // need not be the root the executor resumed, coroutine may have been started inline. Returns false if the
+    // executor is not running anything, then the coroutine continues without suspending.
+    virtual bool yield([[maybe_unused]] Coroutine& coroutine) noexcept { return false; }
+
+   protected:
+    ~Executor() = default;
+};
+
 template <typename T, typename Y>
 concept compatible_yield_type = requires(T&& arg, optional<Y>& y) { y = std::forward<T>(arg); };
 template <typename Y> class YieldingCoroutine;
@@ -83,11 +294,60 @@ concept awaitable = requires(T&& arg, YieldingCoroutine<Y> co) {
 template <typename T, typename Y>
 concept awaitable_range = std::ranges::range<T> && awaitable<std::ranges::range_value_t<T>, Y>;
 
-template <typename Y> class YieldingCoroutine : public Coroutine {
+namespace detail {
+template <typename R, typename Y> struct Pull {
+    Promise<R, Y>& source;
+};
+// Sees the values of a generator inside its co_yield, before they leave the generator. push() returns false to drop
+// the value, the generator then goes on without suspending. Once exhausted() the generator is not resumed after the
+// value it yielded last.
+template <typename Y> class YieldSink {
+   public:
+    virtual bool push(optional<Y>& value) = 0;
+    virtual bool exhausted() const noexcept = 0;
+
+   protected:
+    ~YieldSink() = default;
+};
+// co_await Sink{generator, sink} runs the generator to its end with sink attached. The sink yields the values it
+// passes on from the awaiting coroutine, whose frame is not resumed in between, see pipeline.h.
+template <typename R, typename Y> struct Sink {
+    Promise<R, Y>& source;
+    YieldSink<Y>& sink;
+};
+// What co_yield gives: suspends unless a sink dropped the value.
+struct YieldSuspend {
+    bool dropped;
+    bool await_ready() const noexcept { return dropped; }
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    void await_resume() const noexcept {}
+};
+}  // namespace detail
+// co_await pull(generator) runs the generator until its next co_yield and gives the yielded value, or nothing once it
+// finished. Unlike awaiting it, the values do not travel up the await chain. The generator may suspend in between,
+// the awaiting coroutine then waits with it. A value that refers into the generator is valid until the next pull.
+template <typename R, typename Y>
+    requires(!std::is_void_v<Y>)
+detail::Pull<R, Y> pull(Promise<R, Y>& generator) {
+    return {generator};
+}
+
+namespace detail {
+// Storage of the last yielded value and the sink that sees it first, coroutines that yield no values have neither.
+template <typename Y> class YieldSlot {
+   protected:
+    optional<Y> m_yield_value{};
+    YieldSink<Y>* m_sink{};
+};
+template <> class YieldSlot<void> {};
+}  // namespace detail
+
+template <typename Y> class YieldingCoroutine : public Coroutine, public detail::YieldSlot<Y> {
    public:
-    std::suspend_always yield_value(const YieldNothing&);
-    std::suspend_always yield_value(optional<void>&&) { return yield_value(nothing); }
-    template <typename T> std::suspend_always yield_value(T&& arg);
+    using Coroutine::Coroutine;
+    detail::YieldSuspend yield_value(const YieldNothing&);
+    detail::YieldSuspend yield_value(optional<void>&&) { return yield_value(nothing); }
+    template <typename T> detail::YieldSuspend yield_value(T&& arg);
 
     optional<Y> yielded_value() const noexcept;
 
@@ -101,16 +361,42 @@ template <typename Y> class YieldingCoroutine : public Coroutine {
     template <typename R1, typename Y1> struct Awaiter {
         Promise<R1, Y1> callee;
         bool await_ready();
-        void await_suspend(auto caller_handle);
+        bool await_suspend(auto caller_handle);
         R1 await_resume();
     };
+    template <typename R1, typename Y1> struct PullAwaiter {
+        Promise<R1, Y1> source;
+        bool await_ready();
+        void await_suspend(auto caller_handle);
+        optional<Y1> await_resume();
+    };
+    template <typename R1, typename Y1> struct SinkAwaiter {
+        detail::Sink<R1, Y1> sunk;
+        ~SinkAwaiter() { sunk.source->m_sink = nullptr; }
+        bool await_ready();
+        bool await_suspend(auto caller_handle);
+        void await_resume();
+    };
     using Coroutine::await_transform;  // Necessary to find await_transform(SuspensionPoint<T>)
     template <typename R1, typename Y1> Awaiter<R1, Y1> await_transform(Promise<R1, Y1>&& callee);
     template <typename R1, typename Y1> Awaiter<R1, Y1> await_transform(Promise<R1, Y1>& callee);
+    template <typename R1, typename Y1> PullAwaiter<R1, Y1> await_transform(detail::Pull<R1, Y1> p);
+    template <typename R1, typename Y1> SinkAwaiter<R1, Y1> await_transform(detail::Sink<R1, Y1> s);
     auto await_transform(awaitable_range<Y> auto&& s);
 
    private:
-    optional<Y> m_yield_value{};
+    template <typename> friend class YieldingCoroutine;
+    template <typename Y1> static detail::Forwarded forward_yield(Coroutine& caller, Coroutine& callee) {
+        auto& source = static_cast<YieldingCoroutine<Y1>&>(callee);
+        auto suspend = static_cast<YieldingCoroutine&>(caller).yield_value(source.yielded_value());
+        return suspend.dropped ? detail::Forwarded::dropped : detail::Forwarded::passed;
+    }
+    // The sink of the callee already yielded from caller what it passed on
+    template <typename Y1> static detail::Forwarded sunk_yield(Coroutine& caller, Coroutine& callee) {
+        if (!caller.yielded()) static_cast<YieldingCoroutine&>(caller).yield_value(nothing);
+        auto sink = static_cast<YieldingCoroutine<Y1>&>(callee).m_sink;
+        return sink->exhausted() ? detail::Forwarded::last : detail::Forwarded::passed;
+    }
 };
 
 namespace detail {
@@ -123,12 +409,10 @@ template <typename R> class ReturnValue {
     optional<R> m_return_value{};
 };
 
+// Whether a void coroutine returned follows from done() and exception(), so it stores nothing
 template <> class ReturnValue<void> {
    public:
-    void return_void() { m_return_value.set(); }
-
-   protected:
-    optional<void> m_return_value{};
+    void return_void() noexcept {}
 };
 
 }  // namespace detail
@@ -136,8 +420,17 @@ template <> class ReturnValue<void> {
 template <typename R, typename Y>
 class ReturningCoroutine : public YieldingCoroutine<Y>, public detail::ReturnValue<R> {
    public:
+    // The default argument is evaluated in the coroutine, so it names the coroutine function
+    ReturningCoroutine(const std::source_location& loc = std::source_location::current())
+        : YieldingCoroutine<Y>(loc) {}
     Promise<R, Y> get_return_object();
-    optional<R> returned_value() const noexcept { return this->m_return_value; }
+    optional<R> returned_value() const noexcept {
+        if constexpr (std::is_void_v<R>) {
+            return optional<void>(this->done() && !this->exception());
+        } else {
+            return this->m_return_value;
+        }
+    }
     class Handle : public YieldingCoroutine<Y>::Handle {
        public:
         Handle(ReturningCoroutine& handle) : YieldingCoroutine<Y>::Handle(handle) {}
@@ -156,6 +449,22 @@ template <typename R, typename Y = void> class [[nodiscard]] Promise : public Re
 
 template <typename R, typename Y> Promise<R, Y> ReturningCoroutine<R, Y>::get_return_object() { return {*this}; }
 
+static_assert(sizeof(ReturningCoroutine<void, void>) == sizeof(Coroutine), "Promise<void> outgrew Coroutine");
+
+namespace detail {
+template <typename T> struct awaited_result {
+    using type = T;
+};
+template <typename R> struct awaited_result<Promise<R, void>> {
+    using type = R;
+};
+// What co_await gives for a call returning T: the value itself, or what a non-yielding Promise returns
+template <typename T> using awaited_result_t = typename awaited_result<T>::type;
+
+template <typename T> constexpr bool is_promise = false;
+template <typename R, typename Y> constexpr bool is_promise<Promise<R, Y>> = true;
+}  // namespace detail
+
 namespace detail {
 class WaitObject {
    public:
@@ -170,14 +479,92 @@ class WaitObject {
     bool operator!() const noexcept {
         return !m_handle.has_value();
     }
+    // Lets go of the waiting coroutine without resuming it, which destroys it unless it is held elsewhere. The wait
+    // object may live in its frame.
+    void release() noexcept {
+        if (!m_handle) return;
+        auto old_handle = *m_handle;
+        m_handle.reset();
+    }
 
    protected:
     void resume_handle() {
+        assert(m_handle);
         auto old_handle = *m_handle;
         m_handle.reset();
-        old_handle->resume();
+        trace::woken(old_handle.operator->(), this);
+        if (auto executor = old_handle->executor()) {
+            executor->post(old_handle, m_priority);
+        } else {
+            old_handle->resume();
+        }
     }
     optional<Handle> m_handle;
+    Priority m_priority = Priority::normal;
+
+   public:
+    bool deferred() const noexcept { return m_deferred; }
+
+   protected:
+    bool m_deferred = false;
+};
+
+// Wait object that acts only once the whole chain suspended, when the handle points to the root and the other
+// coroutines of the chain no longer change it. Until then other threads must not see it.
+class DeferredWait : public WaitObject {
+   public:
+    virtual void root_suspended(Coroutine& root) = 0;
+
+   protected:
+    DeferredWait() { m_deferred = true; }
+    ~DeferredWait() = default;
+    void suspend(Coroutine& c, const void* on) {
+        std::move(m_handle) = Handle(c);
+        m_priority = c.priority();
+        c.m_wait_object = this;
+        c.suspending();
+        trace::suspended(&c, on);
+    }
+    static void bind_chain(Coroutine& root, Executor* executor) {
+        for (Coroutine* c = &root; c; c = c->m_calling) {
+            c->m_executor = executor;
+        }
+    }
+};
+
+// Wait object of resume_on(). Once the root of the chain suspended it binds the chain to the target and posts it there.
+class Migration final : public DeferredWait {
+   public:
+    explicit Migration(Executor& target) : m_target(target) {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(auto caller_handle) { suspend(caller_handle.promise(), &m_target); }
+    void await_resume() const noexcept {}
+    void root_suspended(Coroutine& root) override {
+        assert(m_handle);
+        m_handle.reset();
+        bind_chain(root, &m_target);
+        m_target.post(Handle(root), m_priority);  // Last, the chain may continue on another thread right away
+    }
+
+   private:
+    Executor& m_target;
+};
+
+// Wait object of a coroutine that yields to its executor. Once the root of the chain suspended it queues the root
+// again, the executor owns one and arms it in Executor::yield().
+class Requeue final : public DeferredWait {
+   public:
+    explicit Requeue(Executor& executor) : m_executor(executor) {}
+    Requeue(const Requeue&) = delete;
+    void arm(Coroutine& c) { suspend(c, &m_executor); }
+    void root_suspended(Coroutine& root) override {
+        assert(m_handle);
+        m_handle.reset();
+        m_executor.post(Handle(root), m_priority);
+    }
+
+   private:
+    Executor& m_executor;
 };
 
 template <typename T> class ResumeSuspension : public WaitObject {
@@ -220,11 +607,13 @@ template <typename T> class SuspensionPoint : public detail::ResumeSuspension<T>
             assert(!s.m_msg);
             s.m_msg = &m_msg;
         }
+        Awaiter(const Awaiter&) = delete;  // s.m_msg points into the awaiter
         optional<T> m_msg;
     };
     void set_handle(Handle h) {
         assert(!m_handle);
         std::move(m_handle) = h;
+        this->m_priority = h->priority();
         m_msg = nullptr;
     }
 };
@@ -233,44 +622,74 @@ template <typename T> class SuspensionPoint : public detail::ResumeSuspension<T>
 
 // Definitions
 namespace promise {
-inline Coroutine::Coroutine() : m_handle(std::coroutine_handle<Coroutine>::from_promise(*this)) {
-#ifdef TEST
-    auto it = living.find(this);
-    EXPECT_EQ(it, living.end());
+inline Coroutine::Coroutine([[maybe_unused]] const std::source_location& loc) {
+    trace::created(this, loc.function_name());
+#ifdef PROMISE_TRACK_LIVING
+    m_function = loc.function_name();
     living.insert(this);
 #endif
 }
 inline Coroutine::~Coroutine() {
+    trace::destroyed(this);
+    if (m_calling) stop_calling();
 #ifdef TEST
-    auto it = living.find(this);
-    EXPECT_NE(it, living.end());
+    EXPECT_TRUE(living.contains(this));
+#endif
+#ifdef PROMISE_TRACK_LIVING
     living.erase(this);
 #endif
 }
 inline void Coroutine::start() {
+    trace::started(this);
     m_started = true;
     resume();
 }
 
 inline void Coroutine::resume() {
+    trace::resumed(this);
     Handle keep_alive(*this);
     m_yielded = false;
     m_wait_object = nullptr;
-    if (!calling || (calling->handle->resume(), wait_for_calling())) {
-        m_handle.resume();
+    if (!m_calling || (m_calling->resume(), wait_for_calling())) {
+        handle().resume();
     }
+    if (!m_awaited && m_wait_object && m_wait_object->deferred()) {
+        static_cast<detail::DeferredWait*>(m_wait_object)->root_suspended(*this);
+    }
+    trace::stopped(this);
+}
+inline bool Coroutine::YieldAwaiter::await_suspend(std::coroutine_handle<>) {
+    return coroutine.m_executor->yield(coroutine);
 }
+inline detail::Migration Coroutine::await_transform(ResumeOn target) { return detail::Migration(target.executor); }
 inline bool Coroutine::wait_for_calling() {
-    if (calling->handle->done()) {
-        calling.reset();
-        return true;
-    };
-    if (calling->handle->yielded()) {
-        calling->update_yield_value();
+    for (;;) {
+        if (m_calling->done()) {
+            stop_calling();
+            return true;
+        };
+        if (!m_calling->yielded()) break;
+        if (m_pulled) {
+            stop_calling();
+            return true;
+        }
+        if (!m_forward_yield) {
+            yield_nothing();
+            return false;
+        }
+        switch (m_forward_yield(*this, *m_calling)) {
+            case detail::Forwarded::passed:
+                return false;
+            case detail::Forwarded::last:
+                stop_calling();
+                return false;
+            case detail::Forwarded::dropped:
+                m_calling->resume();
+        }
     }
-    if (calling->handle->m_wait_object) {
-        calling->handle->m_wait_object->update_handle({*this});
-        m_wait_object = calling->handle->m_wait_object;
+    if (m_calling->m_wait_object) {
+        m_calling->m_wait_object->update_handle({*this});
+        m_wait_object = m_calling->m_wait_object;
     }
     return false;
 }
@@ -278,70 +697,116 @@ inline bool Coroutine::wait_for_calling() {
 template <typename T> auto Coroutine::await_transform(SuspensionPoint<T>& s) {
     s.set_handle({*this});
     m_wait_object = &s;
-    return SuspensionPoint<T>::Awaiter(s);
+    suspending();
+    trace::suspended(this, &s);
+    return typename SuspensionPoint<T>::Awaiter(s);
 }
 
-template <typename Y> auto YieldingCoroutine<Y>::await_transform(awaitable_range<Y> auto&& s) {
-    return await_transform([&]() -> Promise<void> {
-        size_t left = s.size();
-        SuspensionPoint<void> point;
-        bool suspended = false;
-        auto resume = [&]() {
-            left--;
-            if (suspended && left <= 0) {
-                point.resume();
-            }
-        };
-        for (auto& x : s) {
-            auto waiter = [&, this]() -> Promise<void> { co_await x; resume();}();
-            waiter->start();
-        }
-        if (left > 0) {
-            suspended = true;
-            co_await point;
+namespace detail {
+// Shared state of the coroutines that wait for the elements of a range. It lives in the frame of await_range, the
+// waiting state used to be captured by lambda coroutines whose closures were destroyed before they resumed.
+struct RangeAwait {
+    size_t left;
+    SuspensionPoint<void> point{};
+    bool suspended = false;
+    void finished() {
+        left--;
+        if (suspended && left <= 0) {
+            point.resume();
         }
-    }());
+    }
+};
+template <typename A> Promise<void> await_element(A& x, RangeAwait& state) {
+    co_await x;
+    state.finished();
+}
+// The waiters are not awaited, the awaiting coroutine waits for them
+template <typename Range> Promise<void> await_range(Range& s) {
+    RangeAwait state{s.size()};
+    Coroutine& self = co_await this_coroutine;
+    for (auto& x : s) {
+        auto waiter = await_element(x, state);
+        waiter->waited_for_by(self);
+        waiter->start();
+    }
+    if (state.left > 0) {
+        state.suspended = true;
+        co_await state.point;
+    }
+}
+}  // namespace detail
+
+template <typename Y> auto YieldingCoroutine<Y>::await_transform(awaitable_range<Y> auto&& s) {
+    return await_transform(detail::await_range(s));
 }
 
+#ifdef PROMISE_THREADS
+inline void Coroutine::gain_ref() { m_ref_count.fetch_add(1, std::memory_order_relaxed); }
+inline void Coroutine::lose_ref() {
+    if (m_ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) handle().destroy();
+}
+#else
 inline void Coroutine::gain_ref() { m_ref_count++; }
 inline void Coroutine::lose_ref() {
-    if (!--m_ref_count) m_handle.destroy();
+    if (!--m_ref_count) handle().destroy();
 }
+#endif
 
-template <typename Y> std::suspend_always YieldingCoroutine<Y>::yield_value(const YieldNothing&) {
-    m_yield_value.reset();
-    m_yielded = true;
-    return {};
+template <typename Y> detail::YieldSuspend YieldingCoroutine<Y>::yield_value(const YieldNothing&) {
+    if constexpr (!std::is_void_v<Y>) this->m_yield_value.reset();
+    yield_nothing();
+    return {false};
 }
 
-template <typename Y> template <typename T> std::suspend_always YieldingCoroutine<Y>::yield_value(T&& arg) {
+template <typename Y> template <typename T> detail::YieldSuspend YieldingCoroutine<Y>::yield_value(T&& arg) {
     static_assert(compatible_yield_type<T, Y>, "Given yield value is not compatible with yield type of coroutine");
-    if constexpr (compatible_yield_type<T, Y>) m_yield_value = std::forward<T>(arg);
+    if constexpr (compatible_yield_type<T, Y> && !std::is_void_v<Y>) {
+        this->m_yield_value = std::forward<T>(arg);
+        if (this->m_sink && !this->m_sink->push(this->m_yield_value)) return {true};
+    }
     m_yielded = true;
-    return {};
+    suspending();
+    trace::yielded(this);
+    return {false};
 }
 
 template <typename Y> optional<Y> YieldingCoroutine<Y>::yielded_value() const noexcept {
-    if (yielded())
-        return m_yield_value;
-    else
+    if constexpr (std::is_void_v<Y>) {
+        return {};
+    } else if (yielded()) {
+        return this->m_yield_value;
+    } else {
         return {};
+    }
 }
 template <typename Y> template <typename R1, typename Y1> bool YieldingCoroutine<Y>::Awaiter<R1, Y1>::await_ready() {
-    callee->start();
-
-    return callee->done();
+    if (!callee->started()) callee->start();
+    if (!callee->done()) return false;
+    // Already finished, suspends anyway to yield if the caller used up its budget
+    auto executor = callee->executor();
+    return !executor || !executor->spend_budget();
 }
 
 template <typename Y>
 template <typename R1, typename Y1>
-void YieldingCoroutine<Y>::Awaiter<R1, Y1>::await_suspend(auto caller_handle) {
+bool YieldingCoroutine<Y>::Awaiter<R1, Y1>::await_suspend(auto caller_handle) {
     auto& caller = caller_handle.promise();
-    std::move(caller.calling) = YieldingHandle{callee, [&, *this]() { caller.yield_value(callee->yielded_value()); }};
+    if (callee->done()) return callee->executor()->yield(caller);
+    trace::awaited(static_cast<Coroutine*>(&caller), static_cast<Coroutine*>(callee.operator->()));
+    trace::suspended(static_cast<Coroutine*>(&caller), static_cast<Coroutine*>(callee.operator->()));
+    caller.suspending();
+    if constexpr (std::is_void_v<Y>) {
+        static_assert(std::is_void_v<Y1>, "A coroutine that yields nothing can not pass on values, pull() them");
+        caller.call(*callee.operator->(), nullptr, false);
+    } else {
+        caller.call(*callee.operator->(), &YieldingCoroutine::template forward_yield<Y1>, false);
+    }
     caller.wait_for_calling();
+    return true;
 }
 
 template <typename Y> template <typename R1, typename Y1> R1 YieldingCoroutine<Y>::Awaiter<R1, Y1>::await_resume() {
+    if (callee->exception()) std::rethrow_exception(callee->exception());
     if constexpr (!std::is_void_v<R1>) {
         if (!callee->returned_value()) throw std::runtime_error("Function did not return a value");
         R1 ans = *callee->returned_value();
@@ -349,21 +814,99 @@ template <typename Y> template <typename R1, typename Y1> R1 YieldingCoroutine<Y
     }
 }
 
+template <typename Y>
+template <typename R1, typename Y1>
+bool YieldingCoroutine<Y>::PullAwaiter<R1, Y1>::await_ready() {
+    if (!source->started()) {
+        source->start();
+    } else if (!source->done()) {
+        source->resume();
+    }
+    return source->done() || source->yielded();
+}
+
+template <typename Y>
+template <typename R1, typename Y1>
+void YieldingCoroutine<Y>::PullAwaiter<R1, Y1>::await_suspend(auto caller_handle) {
+    auto& caller = caller_handle.promise();
+    trace::awaited(static_cast<Coroutine*>(&caller), static_cast<Coroutine*>(source.operator->()));
+    trace::suspended(static_cast<Coroutine*>(&caller), static_cast<Coroutine*>(source.operator->()));
+    caller.suspending();
+    caller.call(*source.operator->(), nullptr, true);
+    caller.wait_for_calling();
+}
+
+template <typename Y>
+template <typename R1, typename Y1>
+optional<Y1> YieldingCoroutine<Y>::PullAwaiter<R1, Y1>::await_resume() {
+    if (source->exception()) std::rethrow_exception(source->exception());
+    return source->yielded_value();
+}
+
+template <typename Y>
+template <typename R1, typename Y1>
+YieldingCoroutine<Y>::PullAwaiter<R1, Y1> YieldingCoroutine<Y>::await_transform(detail::Pull<R1, Y1> p) {
+    p.source->awaited_by(*this);
+    return {p.source};
+}
+
+template <typename Y>
+template <typename R1, typename Y1>
+bool YieldingCoroutine<Y>::SinkAwaiter<R1, Y1>::await_ready() {
+    if (!sunk.source->started()) sunk.source->start();
+    return sunk.source->done();
+}
+
+template <typename Y>
+template <typename R1, typename Y1>
+bool YieldingCoroutine<Y>::SinkAwaiter<R1, Y1>::await_suspend(auto caller_handle) {
+    auto& caller = caller_handle.promise();
+    trace::awaited(static_cast<Coroutine*>(&caller), static_cast<Coroutine*>(sunk.source.operator->()));
+    trace::suspended(static_cast<Coroutine*>(&caller), static_cast<Coroutine*>(sunk.source.operator->()));
+    caller.suspending();
+    caller.call(*sunk.source.operator->(), &YieldingCoroutine::template sunk_yield<Y1>, false);
+    caller.wait_for_calling();
+    return true;
+}
+
+template <typename Y>
+template <typename R1, typename Y1>
+void YieldingCoroutine<Y>::SinkAwaiter<R1, Y1>::await_resume() {
+    if (sunk.source->exception()) std::rethrow_exception(sunk.source->exception());
+}
+
+template <typename Y>
+template <typename R1, typename Y1>
+YieldingCoroutine<Y>::SinkAwaiter<R1, Y1> YieldingCoroutine<Y>::await_transform(detail::Sink<R1, Y1> s) {
+    static_assert(!std::is_void_v<Y>, "Only a coroutine that yields values can yield what the sink passes on");
+    s.source->awaited_by(*this);
+    s.source->m_sink = &s.sink;
+    return {s};
+}
+
 template <typename Y>
 template <typename R1, typename Y1>
 YieldingCoroutine<Y>::Awaiter<R1, Y1> YieldingCoroutine<Y>::await_transform(Promise<R1, Y1>&& callee) {
+    callee->awaited_by(*this);
     return {std::move(callee)};
 }
 
 template <typename Y>
 template <typename R1, typename Y1>
 YieldingCoroutine<Y>::Awaiter<R1, Y1> YieldingCoroutine<Y>::await_transform(Promise<R1, Y1>& callee) {
+    callee->awaited_by(*this);
     return {std::move(callee)};
 }
 
 }  // namespace promise
 
 #ifdef GLOBAL_PROMISE
+using promise::Executor;
+using promise::Priority;
+using promise::yield_now;
 using promise::Promise;
+using promise::pull;
+using promise::resume_on;
 using promise::SuspensionPoint;
+using promise::this_coroutine;
 #endif
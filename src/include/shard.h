@@ -0,0 +1,390 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "event_loop.h"
+#include "promise.h"
+#include "spsc_queue.h"
+#include "timer_wheel.h"
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifndef PROMISE_THREADS
+#error "Define PROMISE_THREADS in every translation unit, shards are threads that other threads resume coroutines on"
+#endif
+
+namespace promise {
+
+class Shard;
+class ShardRuntime;
+
+namespace detail {
+
+// A cross-shard call. It runs on the target shard and travels back to the origin, which completes it there.
+class ShardMessage {
+   public:
+    explicit ShardMessage(size_t origin) : m_origin(origin) {}
+    size_t origin() const noexcept { return m_origin; }
+    virtual void run(Shard& target) = 0;
+    virtual void complete() = 0;
+
+   protected:
+    ~ShardMessage() = default;
+    // Sends the message back to its origin, once it ran on target.
+    void reply(Shard& target);
+
+   private:
+    size_t m_origin;
+};
+
+template <typename Fn> class ShardCall;
+
+inline thread_local Shard* current_shard = nullptr;
+
+// CPUs the process may run on, which is the cpuset inside a container.
+inline std::vector<int> usable_cpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Binds the calling thread to cpu, returns false where that is not possible.
+inline bool pin_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void) cpu;
+    return false;
+#endif
+}
+
+}  // namespace detail
+
+// One thread of a ShardRuntime with its own EventLoop. The coroutines of a shard only run on its thread and share no
+// mutable state with other shards, they reach them through invoke(). No coroutine handle crosses shards, so their
+// reference counts are only touched by one thread. Other threads may still resume them, for example through an
+// AtomicSuspensionPoint, which needs the remote queue of PROMISE_THREADS. A sleeping shard is woken by invoke(),
+// ShardRuntime::submit(), by resumptions that other threads post to its loop and by its timers. Frames of coroutines
+// that the thread creates come from a FramePool of the shard.
+class Shard {
+   public:
+    Shard(const Shard&) = delete;
+
+    size_t id() const noexcept { return m_id; }
+    ShardRuntime& runtime() const noexcept { return m_runtime; }
+    EventLoop& loop() noexcept { return m_loop; }
+    // Whether the thread is bound to one CPU, known once the shard ran something.
+    bool pinned() const noexcept { return m_pinned.load(std::memory_order_relaxed); }
+
+    // Shard thread only: binds the promise to the loop of the shard and queues its start.
+    template <typename R, typename Y> void spawn(Promise<R, Y>& promise) { m_loop.spawn(promise); }
+    template <typename R, typename Y> void spawn(Promise<R, Y>&& promise) { m_loop.spawn(promise); }
+
+    // Calls fn on this shard and gives its result, a Promise that fn returns is awaited on this shard. The call and
+    // its result travel over the SPSC queues between the two shards. Must be awaited on a shard thread.
+    template <typename Fn> Promise<detail::awaited_result_t<std::invoke_result_t<Fn&>>> invoke(Fn fn);
+
+    // Continues the caller on this shard once the deadline passed. The timers of a shard are kept in a wheel of
+    // millisecond ticks, which the shard turns between batches. Must be awaited on this shard.
+    Promise<void> sleep_until(std::chrono::steady_clock::time_point deadline);
+    Promise<void> sleep_for(std::chrono::steady_clock::duration duration) {
+        return sleep_until(std::chrono::steady_clock::now() + duration);
+    }
+
+   private:
+    friend class ShardRuntime;
+    friend class detail::ShardMessage;
+    Shard(ShardRuntime& runtime, size_t id, size_t shards, size_t queue_capacity)
+        : m_runtime(runtime), m_id(id), m_overflow(shards) {
+        for (size_t i = 0; i < shards; i++) m_inbound.push_back(std::make_unique<Queue>(queue_capacity));
+        m_loop.set_remote_wake([this] { wake(); });
+    }
+
+    void work(int cpu, bool pin);
+    bool poll();
+    void idle();
+    void send(size_t to, detail::ShardMessage* message);
+    bool flush();
+    bool pending() const noexcept {
+        if (m_stopping.load() || m_submitted.load() || m_loop.remote_pending()) return true;
+        return std::any_of(m_inbound.begin(), m_inbound.end(), [](auto& queue) { return !queue->empty(); });
+    }
+    // Either the sender sees the shard sleeping, or the shard sees what was sent before it sleeps.
+    void wake() {
+        if (!m_sleeping.load() || !m_sleeping.exchange(false)) return;
+        std::lock_guard lock(m_sleep_mutex);
+        m_sleep.notify_one();
+    }
+    void notify(std::atomic<bool>& flag) {
+        flag.store(true);
+        wake();
+    }
+
+    using Queue = detail::SpscQueue<detail::ShardMessage*>;
+    ShardRuntime& m_runtime;
+    size_t m_id;
+    detail::TimerWheel m_timers;  // Outlives the loop, whose dropped coroutines may unlink timers
+    EventLoop m_loop;
+    detail::FramePool m_frames;
+    std::vector<std::unique_ptr<Queue>> m_inbound;              // Indexed by the sending shard
+    std::vector<std::deque<detail::ShardMessage*>> m_overflow;  // Sends waiting for room, by target shard
+    std::atomic<bool> m_sleeping = false;
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_sleep;
+    std::atomic<bool> m_stopping = false;
+    std::atomic<bool> m_pinned = false;
+    std::atomic<bool> m_submitted = false;
+    std::mutex m_submit_mutex;
+    std::vector<std::function<void()>> m_submissions;
+    std::thread m_thread;
+};
+
+// Shared-nothing runtime with one shard per usable CPU, each thread pinned to its own CPU where the platform allows.
+// Work enters through submit(), shards call each other with co_await shard(n).invoke(fn).
+class ShardRuntime {
+   public:
+    // 0 shards means one per CPU the process may use. A full queue between two shards keeps further calls in order
+    // on the sending shard until there is room.
+    explicit ShardRuntime(size_t shards = 0, size_t queue_capacity = 1024, bool pin = true) {
+        auto cpus = detail::usable_cpus();
+        if (!shards) shards = cpus.size();
+        for (size_t i = 0; i < shards; i++) m_shards.emplace_back(new Shard(*this, i, shards, queue_capacity));
+        for (size_t i = 0; i < shards; i++) {
+            m_shards[i]->m_thread = std::thread([this, i, cpu = cpus[i % cpus.size()], pin] {
+                m_shards[i]->work(cpu, pin);
+            });
+        }
+    }
+    ShardRuntime(const ShardRuntime&) = delete;
+    // Stops every shard after its current batch. Coroutines that did not finish are dropped with the loops.
+    ~ShardRuntime() {
+        for (auto& shard : m_shards) shard->notify(shard->m_stopping);
+        for (auto& shard : m_shards) shard->m_thread.join();
+    }
+
+    size_t size() const noexcept { return m_shards.size(); }
+    Shard& at(size_t n) const { return *m_shards.at(n); }
+    // Any thread: runs fn on the thread of shard n, for example to spawn a coroutine there. This takes a lock, the
+    // traffic between shards goes through invoke().
+    void submit(size_t n, std::function<void()> fn) {
+        Shard& shard = at(n);
+        {
+            std::lock_guard lock(shard.m_submit_mutex);
+            shard.m_submissions.push_back(std::move(fn));
+        }
+        shard.notify(shard.m_submitted);
+    }
+
+   private:
+    std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+// The shard of the calling thread, throws std::logic_error outside of shard threads.
+inline Shard& this_shard() {
+    if (!detail::current_shard) throw std::logic_error("not on a shard thread");
+    return *detail::current_shard;
+}
+inline Shard& shard(size_t n) { return this_shard().runtime().at(n); }
+
+inline void Shard::work(int cpu, bool pin) {
+    if (pin) m_pinned.store(detail::pin_thread(cpu), std::memory_order_relaxed);
+    detail::current_shard = this;
+    detail::FramePool::Scope frames(m_frames);
+    m_loop.run();  // Makes the loop belong to this thread
+    while (!m_stopping.load(std::memory_order_acquire)) {
+        bool busy = poll();
+        if (!m_timers.empty() && m_timers.expire(std::chrono::steady_clock::now())) busy = true;
+        if (m_loop.run()) busy = true;
+        if (!busy) idle();
+    }
+    detail::current_shard = nullptr;
+}
+
+// Retries the overflowing sends, then takes the calls and replies of the other shards and the submitted functions.
+inline bool Shard::poll() {
+    bool busy = flush();
+    for (auto& queue : m_inbound) {
+        detail::ShardMessage* message;
+        while (queue->pop(message)) {
+            busy = true;
+            if (message->origin() == m_id) {
+                message->complete();
+            } else {
+                message->run(*this);
+            }
+        }
+    }
+    if (m_submitted.load(std::memory_order_acquire)) {
+        std::vector<std::function<void()>> submissions;
+        {
+            std::lock_guard lock(m_submit_mutex);
+            m_submitted.store(false, std::memory_order_relaxed);
+            submissions.swap(m_submissions);
+        }
+        for (auto& fn : submissions) fn();
+        busy = true;
+    }
+    return busy;
+}
+
+// Sleeps until another thread has something for the shard or its next timer is due. A shard whose sends overflow only
+// yields, it has to retry.
+inline void Shard::idle() {
+    if (std::any_of(m_overflow.begin(), m_overflow.end(), [](auto& sends) { return !sends.empty(); })) {
+        std::this_thread::yield();
+        return;
+    }
+    m_sleeping.store(true);
+    if (!pending()) {
+        std::unique_lock lock(m_sleep_mutex);
+        auto woken = [this] { return !m_sleeping.load(); };
+        if (m_timers.empty()) {
+            m_sleep.wait(lock, woken);
+        } else {
+            m_sleep.wait_until(lock, m_timers.next(), woken);
+        }
+    }
+    m_sleeping.store(false, std::memory_order_relaxed);
+}
+
+inline void Shard::send(size_t to, detail::ShardMessage* message) {
+    Shard& target = m_runtime.at(to);
+    auto& overflow = m_overflow[to];
+    if (!overflow.empty() || !target.m_inbound[m_id]->push(message)) {
+        overflow.push_back(message);
+        return;
+    }
+    target.wake();
+}
+
+inline bool Shard::flush() {
+    bool sent = false;
+    for (size_t to = 0; to < m_overflow.size(); to++) {
+        auto& overflow = m_overflow[to];
+        if (overflow.empty()) continue;
+        Shard& target = m_runtime.at(to);
+        size_t before = overflow.size();
+        while (!overflow.empty() && target.m_inbound[m_id]->push(overflow.front())) overflow.pop_front();
+        if (overflow.size() != before) {
+            target.wake();
+            sent = true;
+        }
+    }
+    return sent;
+}
+
+namespace detail {
+
+inline void ShardMessage::reply(Shard& target) { target.send(m_origin, this); }
+
+template <typename Fn> class ShardCall final : public ShardMessage {
+   public:
+    using Result = std::invoke_result_t<Fn&>;
+    using R = awaited_result_t<Result>;
+    static_assert(!is_promise<R>, "invoke() awaits Promises that do not yield");
+
+    ShardCall(size_t origin, Fn& fn) : ShardMessage(origin), m_fn(fn) {}
+    void run(Shard& target) override {
+        if constexpr (is_promise<Result>) {
+            target.spawn(call(target));
+        } else {
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    m_fn();
+                    m_result.set();
+                } else {
+                    m_result = m_fn();
+                }
+            } catch (...) {
+                m_error = std::current_exception();
+            }
+            reply(target);
+        }
+    }
+    void complete() override { m_done.resume(); }
+    R take() {
+        if (m_error) std::rethrow_exception(m_error);
+        if constexpr (!std::is_void_v<R>) return std::move(*m_result);
+    }
+
+    SuspensionPoint<void> m_done;
+
+   private:
+    Promise<void> call(Shard& target) {
+        try {
+            if constexpr (std::is_void_v<R>) {
+                co_await m_fn();
+                m_result.set();
+            } else {
+                m_result = co_await m_fn();
+            }
+        } catch (...) {
+            m_error = std::current_exception();
+        }
+        reply(target);
+    }
+
+    Fn& m_fn;
+    optional<R> m_result;
+    std::exception_ptr m_error;
+};
+
+}  // namespace detail
+
+template <typename Fn> Promise<detail::awaited_result_t<std::invoke_result_t<Fn&>>> Shard::invoke(Fn fn) {
+    Shard& from = this_shard();
+    if (&from == this) {
+        if constexpr (detail::is_promise<std::invoke_result_t<Fn&>>) {
+            co_return co_await fn();
+        } else {
+            co_return fn();
+        }
+    }
+    detail::ShardCall<Fn> call(from.id(), fn);
+    from.send(m_id, &call);
+    co_await call.m_done;
+    co_return call.take();
+}
+
+inline Promise<void> Shard::sleep_until(std::chrono::steady_clock::time_point deadline) {
+    if (detail::current_shard != this) throw std::logic_error("sleep_until() must be awaited on its shard");
+    detail::TimerWheel::Timer timer(m_timers, deadline);
+    co_await timer.point;
+}
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::shard;
+using promise::Shard;
+using promise::ShardRuntime;
+using promise::this_shard;
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace promise::detail {
+
+// Only the owning thread writes its counters, so plain load + store is enough.
+template <typename T> void bump(std::atomic<T>& counter, T by = 1) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+struct NoLocal {};
+
+// Statistics that every thread counts in its own shard and that are merged on read, see hook_stats.h and frame_stats.h.
+// A shard holds the Counters of every id the thread used and a Local of the thread. Derived gets the shard of a
+// finishing thread in retire(), to keep its counts. The owner reads its table without a lock, other threads hold the
+// lock of the registry and then the one of the shard.
+template <typename Derived, typename Counters, typename Local = NoLocal> class ShardedRegistry {
+   public:
+    class Shard {
+       public:
+        explicit Shard(ShardedRegistry& registry) : m_registry(registry) { m_registry.attach(this); }
+        Shard(const Shard&) = delete;
+        ~Shard() { m_registry.detach(this); }
+        Counters* find(uint32_t id) const noexcept { return id < m_counters.size() ? m_counters[id].get() : nullptr; }
+        // Only the owning thread adds counters, taking the lock of the shard.
+        template <typename... A> Counters& emplace(uint32_t id, A&&... args) {
+            std::lock_guard lock(m_mutex);
+            if (id >= m_counters.size()) m_counters.resize(id + 1);
+            m_counters[id] = std::make_unique<Counters>(std::forward<A>(args)...);
+            return *m_counters[id];
+        }
+        template <typename F> void for_each(F&& f) const {
+            for (uint32_t id = 0; id < m_counters.size(); id++) {
+                if (m_counters[id]) f(id, *m_counters[id]);
+            }
+        }
+        [[no_unique_address]] Local local;
+
+       private:
+        friend class ShardedRegistry;
+        ShardedRegistry& m_registry;
+        std::mutex m_mutex;
+        std::vector<std::unique_ptr<Counters>> m_counters;
+    };
+
+    // The shard of this thread, nullptr once the thread destroyed it and still runs destructors of other objects.
+    Shard* local() {
+        thread_local bool finished = false;
+        if (finished) return nullptr;
+        thread_local struct Owner {
+            Shard shard;
+            ~Owner() { finished = true; }
+        } owner{Shard(*this)};
+        return &owner.shard;
+    }
+
+   protected:
+    // Calls f(counters) for the counters of id on every living thread, the caller holds m_mutex.
+    template <typename F> void for_each_thread(uint32_t id, F&& f) {
+        for (auto shard : m_shards) {
+            std::lock_guard lock(shard->m_mutex);
+            if (auto counters = shard->find(id)) f(*counters);
+        }
+    }
+    // Calls f(shard) for every living thread, the caller holds m_mutex.
+    template <typename F> void for_each_shard(F&& f) {
+        for (auto shard : m_shards) {
+            std::lock_guard lock(shard->m_mutex);
+            f(std::as_const(*shard));
+        }
+    }
+    std::mutex m_mutex;
+
+   private:
+    void attach(Shard* shard) {
+        std::lock_guard lock(m_mutex);
+        m_shards.push_back(shard);
+    }
+    void detach(Shard* shard) {
+        std::lock_guard lock(m_mutex);
+        std::erase(m_shards, shard);
+        std::lock_guard shard_lock(shard->m_mutex);
+        static_cast<Derived*>(this)->retire(std::as_const(*shard));
+    }
+    std::vector<Shard*> m_shards;
+};
+
+}  // namespace promise::detail
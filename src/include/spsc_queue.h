@@ -0,0 +1,54 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace promise::detail {
+
+// Bounded ring between one producer and one consumer thread. Each side caches the index of the other one and only
+// reads the shared index when the ring looks full or empty. The tail is published sequentially consistent, so a
+// consumer that announces it goes to sleep and then finds the ring empty is seen sleeping by the producer.
+template <typename T> class SpscQueue {
+   public:
+    explicit SpscQueue(size_t capacity) : m_slots(std::bit_ceil(std::max<size_t>(capacity, 2))) {}
+    SpscQueue(const SpscQueue&) = delete;
+
+    bool push(T value) noexcept(std::is_nothrow_move_assignable_v<T>) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head_cache == m_slots.size()) {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if (tail - m_head_cache == m_slots.size()) return false;
+        }
+        m_slots[tail & (m_slots.size() - 1)] = std::move(value);
+        m_tail.store(tail + 1);
+        return true;
+    }
+    bool pop(T& value) noexcept(std::is_nothrow_move_assignable_v<T>) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail_cache) {
+            m_tail_cache = m_tail.load(std::memory_order_acquire);
+            if (head == m_tail_cache) return false;
+        }
+        value = std::move(m_slots[head & (m_slots.size() - 1)]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    // Consumer only
+    bool empty() const noexcept { return m_head.load(std::memory_order_relaxed) == m_tail.load(); }
+    // Producer only
+    bool full() const noexcept { return m_tail.load(std::memory_order_relaxed) - m_head.load() == m_slots.size(); }
+    size_t capacity() const noexcept { return m_slots.size(); }
+
+   private:
+    std::vector<T> m_slots;
+    alignas(64) std::atomic<size_t> m_head{};  // Written by the consumer
+    size_t m_tail_cache = 0;
+    alignas(64) std::atomic<size_t> m_tail{};  // Written by the producer
+    size_t m_head_cache = 0;
+};
+
+}  // namespace promise::detail
@@ -0,0 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <utility>
+
+#include "atomic_suspension_point.h"
+#include "promise.h"
+#include "spsc_queue.h"
+
+#ifndef PROMISE_THREADS
+#error "Define PROMISE_THREADS in every translation unit to resume coroutines on other threads"
+#endif
+
+namespace promise {
+
+namespace detail {
+
+// Shared by the producer and the consumer of a stream. A side sleeps only when the ring is full or empty. It announces
+// that in its flag and checks the ring again, the other side wakes it by taking the flag back, so exactly one of them
+// resumes the point.
+template <typename Y> struct StreamState {
+    StreamState(size_t capacity, size_t batch)
+        : ring(capacity), batch(std::clamp<size_t>(batch, 1, ring.capacity())), refill(ring.capacity() / 2) {}
+    SpscQueue<optional<Y>> ring;
+    size_t batch;   // Pushes before the producer looks for a sleeping consumer
+    size_t refill;  // Pops before the consumer looks for a sleeping producer
+    std::atomic<bool> closed = false;     // Set by the producer after its last push
+    std::atomic<bool> cancelled = false;  // Set once the consumer is gone
+    std::exception_ptr error;             // Of the source, published by closed
+    std::atomic<bool> consumer_waiting = false;
+    std::atomic<bool> producer_waiting = false;
+    AtomicSuspensionPoint<void> not_empty;
+    AtomicSuspensionPoint<void> not_full;
+
+    static void wake(std::atomic<bool>& waiting, AtomicSuspensionPoint<void>& point) {
+        if (waiting.load() && waiting.exchange(false)) point.resume();
+    }
+};
+
+template <typename R, typename Y> Promise<void> produce(std::shared_ptr<StreamState<Y>> state, Promise<R, Y> source) {
+    size_t pushed = 0;
+    try {
+        while (auto value = co_await pull(source)) {
+            while (state->ring.full() && !state->cancelled.load(std::memory_order_relaxed)) {
+                state->producer_waiting.store(true);
+                if (state->ring.full() && !state->cancelled.load()) {
+                    co_await state->not_full;
+                } else if (!state->producer_waiting.exchange(false)) {
+                    co_await state->not_full;  // The consumer took the flag, its resume is on the way
+                }
+            }
+            if (state->cancelled.load(std::memory_order_relaxed)) break;
+            state->ring.push(std::move(*value));
+            if (++pushed >= state->batch || state->ring.full()) {
+                pushed = 0;
+                StreamState<Y>::wake(state->consumer_waiting, state->not_empty);
+            }
+        }
+    } catch (...) {
+        state->error = std::current_exception();
+    }
+    state->closed.store(true);
+    StreamState<Y>::wake(state->consumer_waiting, state->not_empty);
+}
+
+template <typename Y> Promise<void, Y> consume(std::shared_ptr<StreamState<Y>> state) {
+    struct Cancel {
+        StreamState<Y>& state;
+        // A consumer that stops early lets a producer that waits for room finish
+        ~Cancel() {
+            state.cancelled.store(true);
+            StreamState<Y>::wake(state.producer_waiting, state.not_full);
+        }
+    } cancel{*state};
+    size_t popped = 0;
+    optional<Y> value;
+    for (;;) {
+        if (state->ring.pop(value)) {
+            if (++popped >= state->refill) {
+                popped = 0;
+                std::atomic_thread_fence(std::memory_order_seq_cst);  // Orders the pops before reading the flag
+                StreamState<Y>::wake(state->producer_waiting, state->not_full);
+            }
+            co_yield std::move(*value);
+            continue;
+        }
+        if (state->closed.load()) {
+            if (!state->ring.empty()) continue;  // Pushed right before closing
+            break;
+        }
+        state->consumer_waiting.store(true);
+        if (state->ring.empty() && !state->closed.load()) {
+            co_await state->not_empty;
+        } else if (!state->consumer_waiting.exchange(false)) {
+            co_await state->not_empty;  // The producer took the flag, its resume is on the way
+        }
+    }
+    if (state->error) std::rethrow_exception(state->error);
+}
+
+}  // namespace detail
+
+// Runs the generator source on executor and gives its values through a ring of capacity elements (rounded up to a
+// power of two), so producer and consumer overlap. The producer only suspends on a full ring and the consumer only on
+// an empty one. Consume the returned generator with co_await pull() from a coroutine bound to an executor, otherwise it
+// continues on the producer thread after waiting.
+// Wakeups are batched: a sleeping consumer is woken after batch elements, when the ring is full or when the source
+// finished, a sleeping producer once half the ring is free. A source that suspends between its values may hold back
+// up to batch - 1 of them. An exception of the source is rethrown once the consumer took the values before it.
+// Destroying the generator early stops the producer at its next value.
+template <typename R, typename Y>
+    requires(!std::is_void_v<Y>)
+Promise<void, Y> stream(Promise<R, Y> source, Executor& executor, size_t capacity = 64, size_t batch = 1) {
+    auto state = std::make_shared<detail::StreamState<Y>>(capacity, batch);
+    auto producer = detail::produce(state, std::move(source));
+    producer->set_executor(&executor);
+    executor.post(producer, producer->priority());
+    return detail::consume(std::move(state));
+}
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::stream;
+#endif
@@ -0,0 +1,110 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <utility>
+
+#include "promise.h"
+
+namespace promise {
+
+// Owner of a set of child coroutines that is awaited as a unit. At most limit children run at once, co_await spawn()
+// waits for a free slot before it starts the next one. The first child that throws cancels the group and join()
+// rethrows its exception. Cancellation is cooperative: children that did not start yet are dropped, running ones
+// can check cancelled().
+// Children inherit the executor and priority of the coroutine that spawns them and a copy of its locals. The group must
+// outlive its children, so join it before it goes out of scope.
+class TaskGroup {
+   public:
+    explicit TaskGroup(size_t limit = std::numeric_limits<size_t>::max()) : m_limit(limit) { assert(limit > 0); }
+    TaskGroup(const TaskGroup&) = delete;
+    ~TaskGroup() { assert(!m_active && m_waiting.empty()); }
+
+    template <typename R, typename Y> Promise<void> spawn(Promise<R, Y> child) {
+        if (m_cancelled) co_return;
+        if (m_active < m_limit) {
+            m_active++;
+        } else {
+            Waiter waiter;
+            m_waiting.push_back(&waiter);
+            co_await waiter.point;
+            if (!waiter.granted) co_return;
+            if (m_cancelled) {
+                release();
+                co_return;
+            }
+        }
+        m_peak = std::max(m_peak, m_active);
+        Coroutine& self = co_await this_coroutine;
+        auto runner = run(std::move(child));
+        runner->inherit(self);
+        runner->start();
+    }
+    // Waits until all children finished and rethrows the exception of the first one that failed.
+    Promise<void> join() {
+        if (m_active) {
+            assert(!m_joining);
+            SuspensionPoint<void> finished;
+            m_joining = &finished;
+            co_await finished;
+        }
+        if (m_error) std::rethrow_exception(m_error);
+    }
+    // Drops the children that wait for a slot and lets the running ones know through cancelled().
+    void cancel() {
+        m_cancelled = true;
+        while (!m_waiting.empty()) wake(false);
+    }
+
+    bool cancelled() const noexcept { return m_cancelled; }
+    size_t active() const noexcept { return m_active; }
+    size_t waiting() const noexcept { return m_waiting.size(); }
+    size_t peak() const noexcept { return m_peak; }
+    std::exception_ptr error() const noexcept { return m_error; }
+
+   private:
+    template <typename R, typename Y> Promise<void> run(Promise<R, Y> child) {
+        try {
+            co_await child;
+        } catch (...) {
+            if (!m_error) m_error = std::current_exception();
+            cancel();
+        }
+        release();
+    }
+    // A spawner that waits takes over the slot, so join() cannot finish before the children it is about to start.
+    void release() {
+        if (!m_waiting.empty() && !m_cancelled) {
+            wake(true);
+        } else if (!--m_active && m_joining) {
+            std::exchange(m_joining, nullptr)->resume();
+        }
+    }
+    void wake(bool granted) {
+        auto waiter = m_waiting.front();
+        m_waiting.pop_front();
+        waiter->granted = granted;
+        waiter->point.resume();
+    }
+    struct Waiter {
+        SuspensionPoint<void> point;
+        bool granted = false;
+    };
+
+    size_t m_limit;
+    size_t m_active = 0;
+    size_t m_peak = 0;
+    bool m_cancelled = false;
+    std::exception_ptr m_error;
+    std::deque<Waiter*> m_waiting;
+    SuspensionPoint<void>* m_joining = nullptr;
+};
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::TaskGroup;
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "promise.h"
+
+#ifndef PROMISE_THREADS
+#error "Define PROMISE_THREADS in every translation unit to resume coroutines on other threads"
+#endif
+
+namespace promise {
+
+// Executor that resumes coroutines on a fixed set of worker threads, the highest priority first. A chain runs on one
+// thread at a time, but it can continue on another worker after every suspension, so coroutines bound to the pool
+// may only share state with other threads through synchronisation.
+class ThreadPool : public Executor {
+   public:
+    explicit ThreadPool(size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+        for (size_t i = 0; i < threads; i++) m_threads.emplace_back([this] { work(); });
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    // Finishes the resumptions that are running, the queued ones are dropped.
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_ready_changed.notify_all();
+        for (auto& thread : m_threads) thread.join();
+    }
+
+    void post(Coroutine::Handle handle, Priority priority) override {
+        {
+            std::lock_guard lock(m_mutex);
+            m_ready[static_cast<size_t>(priority)].push_back(handle);
+        }
+        m_ready_changed.notify_one();
+    }
+    // Binds the promise to the pool and queues its start.
+    template <typename R, typename Y> void spawn(Promise<R, Y>& promise) {
+        promise->set_executor(this);
+        post(promise, promise->priority());
+    }
+    template <typename R, typename Y> void spawn(Promise<R, Y>&& promise) { spawn(promise); }
+
+    size_t threads() const noexcept { return m_threads.size(); }
+    size_t size() {
+        std::lock_guard lock(m_mutex);
+        size_t total = 0;
+        for (auto& ready : m_ready) total += ready.size();
+        return total;
+    }
+
+   private:
+    void work() {
+        std::unique_lock lock(m_mutex);
+        for (;;) {
+            if (m_stopping) return;
+            auto ready = std::find_if(m_ready.begin(), m_ready.end(), [](auto& r) { return !r.empty(); });
+            if (ready == m_ready.end()) {
+                m_ready_changed.wait(lock);
+                continue;
+            }
+            {
+                Coroutine::Handle handle = ready->front();
+                ready->pop_front();
+                lock.unlock();
+                if (!handle->started()) {
+                    handle->start();
+                } else if (!handle->done()) {
+                    handle->resume();
+                }
+            }  // The last handle may destroy the coroutine, not while holding the lock
+            lock.lock();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_ready_changed;
+    std::array<std::deque<Coroutine::Handle>, priority_count> m_ready;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+};
+
+// Shared pool with a thread per core, for parallel_map() without an explicit pool.
+inline ThreadPool& default_pool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+}  // namespace promise
+
+#ifdef GLOBAL_PROMISE
+using promise::ThreadPool;
+#endif
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "promise.h"
+
+namespace promise::detail {
+
+// Timers of one thread in a ring of slots that are one tick wide. A timer is linked into the slot of the tick of its
+// deadline, one that is more than a turn of the wheel away stays in its slot while the wheel turns. Adding and
+// removing a timer does not depend on how many there are. expire() only visits the slots of the ticks that passed.
+class TimerWheel {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    // Resumes the coroutine waiting on point once the wheel expired the deadline. Unlinks itself when it is destroyed
+    // before, for example with the frame of a dropped Promise.
+    class Timer {
+       public:
+        Timer(TimerWheel& wheel, Clock::time_point deadline) : m_deadline(deadline) { wheel.link(this); }
+        Timer(const Timer&) = delete;
+        ~Timer() {
+            if (m_wheel) m_wheel->unlink(this);
+        }
+        Clock::time_point deadline() const noexcept { return m_deadline; }
+        SuspensionPoint<void> point;
+
+       private:
+        friend class TimerWheel;
+        Clock::time_point m_deadline;
+        TimerWheel* m_wheel = nullptr;  // nullptr once expired
+        Timer* m_prev = nullptr;
+        Timer* m_next = nullptr;
+        size_t m_slot = 0;
+    };
+
+    explicit TimerWheel(Clock::duration tick = std::chrono::milliseconds(1), size_t slots = 256,
+                        Clock::time_point start = Clock::now())
+        : m_tick(tick), m_start(start), m_slots(slots) {}
+    TimerWheel(const TimerWheel&) = delete;
+    // Sleepers that were not woken are dropped, their timers keep their frames alive otherwise.
+    ~TimerWheel() {
+        for (auto& head : m_slots) {
+            while (Timer* timer = head) {
+                unlink(timer);
+                timer->point.release();
+            }
+        }
+    }
+
+    size_t size() const noexcept { return m_size; }
+    bool empty() const noexcept { return !m_size; }
+
+    // The earliest deadline, Clock::time_point::max() without timers.
+    Clock::time_point next() const noexcept {
+        auto earliest = Clock::time_point::max();
+        if (!m_size) return earliest;
+        for (size_t i = 0; i < m_slots.size(); i++) {
+            size_t tick = m_current + i;
+            auto turn_end = m_start + (tick + 1) * m_tick;  // Timers of later turns share the slot
+            bool this_turn = false;
+            for (Timer* timer = m_slots[tick % m_slots.size()]; timer; timer = timer->m_next) {
+                if (timer->m_deadline < earliest) earliest = timer->m_deadline;
+                this_turn |= timer->m_deadline < turn_end;
+            }
+            if (this_turn) break;
+        }
+        return earliest;
+    }
+
+    // Resumes the timers whose deadline is not after now, returns how many.
+    size_t expire(Clock::time_point now) {
+        if (!m_size) return 0;
+        size_t now_tick = tick_of(now);
+        if (now_tick < m_current) return 0;
+        size_t expired = 0;
+        // A slot may be visited again when the tick of now did not end yet
+        size_t last = std::min(now_tick, m_current + m_slots.size() - 1);
+        for (size_t tick = m_current; tick <= last; tick++) expired += expire_slot(tick % m_slots.size(), now);
+        m_current = now_tick;
+        return expired;
+    }
+
+   private:
+    size_t tick_of(Clock::time_point time) const noexcept {
+        return time <= m_start ? 0 : static_cast<size_t>((time - m_start) / m_tick);
+    }
+    void link(Timer* timer) {
+        // Deadlines that passed already go to the slot that expire() visits first
+        size_t slot = std::max(tick_of(timer->m_deadline), m_current) % m_slots.size();
+        timer->m_wheel = this;
+        timer->m_slot = slot;
+        timer->m_next = m_slots[slot];
+        if (timer->m_next) timer->m_next->m_prev = timer;
+        m_slots[slot] = timer;
+        m_size++;
+    }
+    void unlink(Timer* timer) noexcept {
+        if (timer->m_prev) {
+            timer->m_prev->m_next = timer->m_next;
+        } else {
+            m_slots[timer->m_slot] = timer->m_next;
+        }
+        if (timer->m_next) timer->m_next->m_prev = timer->m_prev;
+        timer->m_wheel = nullptr;
+        timer->m_prev = timer->m_next = nullptr;
+        m_size--;
+    }
+    // One at a time, a resumption may destroy other timers of the slot
+    size_t expire_slot(size_t slot, Clock::time_point now) {
+        size_t expired = 0;
+        for (;;) {
+            Timer* timer = m_slots[slot];
+            while (timer && timer->m_deadline > now) timer = timer->m_next;
+            if (!timer) return expired;
+            unlink(timer);
+            expired++;
+            timer->point.resume();
+        }
+    }
+
+    Clock::duration m_tick;
+    Clock::time_point m_start;
+    std::vector<Timer*> m_slots;
+    size_t m_current = 0;  // Tick that the last expire() reached
+    size_t m_size = 0;
+};
+
+}  // namespace promise::detail
@@ -0,0 +1,287 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <type_traits>
+#include <vector>
+
+// Coroutine lifecycle tracing, exported as Chrome trace event JSON (chrome://tracing or ui.perfetto.dev).
+// Define PROMISE_TRACE (in every translation unit) to record events, otherwise all trace points compile away.
+namespace promise::trace {
+
+#ifdef PROMISE_TRACE
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+// A coroutine runs on a thread from resumed until stopped, when the call of resume() that ran it returns.
+enum class Kind : uint8_t { created, started, suspended, yielded, resumed, stopped, woken, awaited, done, destroyed };
+
+struct Event {
+    uint64_t time;          // Nanoseconds of the steady clock
+    const void* coroutine;  // The coroutine the event happened to
+    const void* other;      // What it was suspended on, the awaited coroutine or the suspension point that woke it
+    const char* name;       // Function name, only set for created
+    Kind kind;
+};
+
+namespace detail {
+
+// Ring buffer with a single writer, the oldest events are overwritten once it is full. Other threads can export and
+// clear it while the owner records. Slots are stored as atomic words, and exporting drops the events the owner may have
+// overwritten while they were copied, like the readers of a seqlock.
+class Ring {
+   public:
+    static constexpr size_t capacity = size_t{1} << 15;
+    explicit Ring(uint32_t thread) : thread(thread), m_slots(capacity) {}
+    Ring(const Ring&) = delete;
+    void push(const Event& event) noexcept {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        m_claimed.store(head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Words words;
+        std::memcpy(&words, &event, sizeof(Event));
+        auto& slot = m_slots[head & (capacity - 1)];
+        for (size_t i = 0; i < words.size(); i++) slot[i].store(words[i], std::memory_order_relaxed);
+        m_head.store(head + 1, std::memory_order_release);
+    }
+    // The recorded events, oldest first.
+    std::vector<Event> events() const {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        uint64_t begin = std::max(m_begin.load(std::memory_order_relaxed), head > capacity ? head - capacity : 0);
+        begin = std::min(begin, head);
+        std::vector<Event> result;
+        result.reserve(head - begin);
+        for (uint64_t i = begin; i < head; i++) {
+            Words words;
+            auto& slot = m_slots[i & (capacity - 1)];
+            for (size_t j = 0; j < words.size(); j++) words[j] = slot[j].load(std::memory_order_relaxed);
+            std::memcpy(&result.emplace_back(), &words, sizeof(Event));
+        }
+        // Events the owner started to write over meanwhile may be torn
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t claimed = m_claimed.load(std::memory_order_relaxed);
+        if (claimed > begin + capacity) {
+            auto torn = std::min<uint64_t>(claimed - begin - capacity, result.size());
+            result.erase(result.begin(), result.begin() + torn);
+        }
+        return result;
+    }
+    // Forgets the events recorded so far. The owner keeps its position, so it may record meanwhile.
+    void clear() noexcept { m_begin.store(m_head.load(std::memory_order_acquire), std::memory_order_relaxed); }
+    const uint32_t thread;
+    std::atomic<bool> finished = false;  // Set when the thread exits, nothing is recorded after it
+
+   private:
+    static_assert(std::is_trivially_copyable_v<Event> && sizeof(Event) % sizeof(uint64_t) == 0);
+    using Words = std::array<uint64_t, sizeof(Event) / sizeof(uint64_t)>;
+    std::vector<std::array<std::atomic<uint64_t>, sizeof(Event) / sizeof(uint64_t)>> m_slots;
+    std::atomic<uint64_t> m_head{};     // Events before it are written
+    std::atomic<uint64_t> m_claimed{};  // Events before it may be written, one ahead of m_head during a push
+    std::atomic<uint64_t> m_begin{};    // Events before it were cleared
+};
+
+// Owns the rings, so the events of finished threads can still be exported. Their rings are dropped once exported,
+// and beyond max_finished of them the oldest go when the next thread starts tracing.
+class Registry {
+   public:
+    static constexpr size_t max_finished = 64;
+    std::shared_ptr<Ring> add() {
+        std::lock_guard lock(m_mutex);
+        auto finished = [](auto& ring) { return ring->finished.load(std::memory_order_relaxed); };
+        if ((size_t) std::count_if(m_rings.begin(), m_rings.end(), finished) >= max_finished) {
+            m_rings.erase(std::find_if(m_rings.begin(), m_rings.end(), finished));
+        }
+        return m_rings.emplace_back(std::make_shared<Ring>(++m_threads));
+    }
+    std::vector<std::shared_ptr<Ring>> rings() {
+        std::lock_guard lock(m_mutex);
+        return m_rings;
+    }
+    // Forgets the rings of finished threads whose events were exported.
+    void drop(const std::vector<std::shared_ptr<Ring>>& exported) {
+        std::lock_guard lock(m_mutex);
+        std::erase_if(m_rings, [&](auto& ring) {
+            return std::find(exported.begin(), exported.end(), ring) != exported.end();
+        });
+    }
+
+   private:
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<Ring>> m_rings;
+    uint32_t m_threads = 0;
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+inline Ring& ring() {
+    struct Owner {
+        std::shared_ptr<Ring> ring = registry().add();
+        ~Owner() { ring->finished.store(true, std::memory_order_release); }
+    };
+    thread_local Owner owner;
+    return *owner.ring;
+}
+
+inline void record(Kind kind, const void* coroutine, const void* other = nullptr, const char* name = nullptr) noexcept {
+    auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch());
+    ring().push({(uint64_t) time.count(), coroutine, other, name, kind});
+}
+
+struct Recorded {
+    Event event;
+    uint32_t thread;
+};
+
+inline void write_string(std::ostream& out, const char* s) {
+    out << '"';
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\') out << '\\';
+        out << *s;
+    }
+    out << '"';
+}
+
+inline void write_id(std::ostream& out, const void* p) { out << "\"0x" << std::hex << (uintptr_t) p << std::dec << '"'; }
+
+}  // namespace detail
+
+// Trace points, called by the library.
+#ifdef PROMISE_TRACE
+inline void created(const void* co, const char* name) noexcept { detail::record(Kind::created, co, nullptr, name); }
+inline void started(const void* co) noexcept { detail::record(Kind::started, co); }
+inline void suspended(const void* co, const void* on) noexcept { detail::record(Kind::suspended, co, on); }
+inline void yielded(const void* co) noexcept { detail::record(Kind::yielded, co); }
+inline void resumed(const void* co) noexcept { detail::record(Kind::resumed, co); }
+inline void stopped(const void* co) noexcept { detail::record(Kind::stopped, co); }
+inline void woken(const void* co, const void* point) noexcept { detail::record(Kind::woken, co, point); }
+inline void awaited(const void* caller, const void* callee) noexcept { detail::record(Kind::awaited, caller, callee); }
+inline void done(const void* co) noexcept { detail::record(Kind::done, co); }
+inline void destroyed(const void* co) noexcept { detail::record(Kind::destroyed, co); }
+#else
+inline void created(const void*, const char*) noexcept {}
+inline void started(const void*) noexcept {}
+inline void suspended(const void*, const void*) noexcept {}
+inline void yielded(const void*) noexcept {}
+inline void resumed(const void*) noexcept {}
+inline void stopped(const void*) noexcept {}
+inline void woken(const void*, const void*) noexcept {}
+inline void awaited(const void*, const void*) noexcept {}
+inline void done(const void*) noexcept {}
+inline void destroyed(const void*) noexcept {}
+#endif
+
+// All recorded events of all threads, ordered by time. The events of threads that exited are only given once, their
+// rings are dropped afterwards.
+inline std::vector<detail::Recorded> events() {
+    std::vector<detail::Recorded> result;
+    std::vector<std::shared_ptr<detail::Ring>> finished;
+    for (auto& ring : detail::registry().rings()) {
+        if (ring->finished.load(std::memory_order_acquire)) finished.push_back(ring);
+        for (auto& event : ring->events()) result.push_back({event, ring->thread});
+    }
+    detail::registry().drop(finished);
+    std::stable_sort(result.begin(), result.end(),
+                     [](const auto& a, const auto& b) { return a.event.time < b.event.time; });
+    return result;
+}
+
+inline void clear() {
+    for (auto& ring : detail::registry().rings()) ring->clear();
+}
+
+// Writes the recorded events as Chrome trace event JSON. Every coroutine is an async track that shows the time it
+// was suspended, and every run of a coroutine a slice of the thread it ran on. Flow arrows lead from the slice that
+// awaited a coroutine to the slice in which it completed.
+inline void write_json(std::ostream& out) {
+    auto recorded = events();
+    uint64_t origin = recorded.empty() ? 0 : recorded.front().event.time;
+    std::map<const void*, const char*> names;
+    std::set<const void*> suspended;
+    std::set<const void*> awaited;
+    std::map<uint32_t, std::vector<const void*>> running;  // The nested runs on every thread
+    bool first = true;
+    auto write = [&](const detail::Recorded& r, const void* id, const char* ph, const char* cat, const char* name,
+                     const void* arg = nullptr) {
+        out << (first ? "\n" : ",\n") << "{\"ph\":\"" << ph << "\",\"cat\":\"" << cat << "\",\"name\":";
+        first = false;
+        detail::write_string(out, name);
+        if (id) {
+            out << ",\"id\":";
+            detail::write_id(out, id);
+        }
+        out << ",\"pid\":1,\"tid\":" << r.thread << ",\"ts\":" << (r.event.time - origin) / 1000 << "."
+            << (r.event.time - origin) % 1000 / 100;
+        if (*ph == 'f') out << ",\"bp\":\"e\"";
+        if (arg) {
+            out << ",\"args\":{\"on\":";
+            detail::write_id(out, arg);
+            out << "}";
+        }
+        out << "}";
+    };
+    out << "{\"traceEvents\":[";
+    for (auto& r : recorded) {
+        const void* co = r.event.coroutine;
+        const char* name = names.count(co) ? names[co] : "coroutine";
+        switch (r.event.kind) {
+            case Kind::created:
+                names[co] = r.event.name;
+                write(r, co, "b", "coroutine", r.event.name);
+                break;
+            case Kind::started:
+                write(r, co, "n", "coroutine", "start");
+                break;
+            case Kind::suspended:
+                if (suspended.insert(co).second) write(r, co, "b", "coroutine", "suspended", r.event.other);
+                break;
+            case Kind::yielded:
+                write(r, co, "n", "coroutine", "yield");
+                break;
+            case Kind::resumed:
+                if (suspended.erase(co)) write(r, co, "e", "coroutine", "suspended");
+                running[r.thread].push_back(co);
+                write(r, nullptr, "B", "run", name);
+                break;
+            case Kind::stopped:
+                // Runs whose start was overwritten in the ring are left out
+                if (auto& runs = running[r.thread]; !runs.empty() && runs.back() == co) {
+                    runs.pop_back();
+                    write(r, nullptr, "E", "run", name);
+                }
+                break;
+            case Kind::woken:
+                write(r, co, "n", "coroutine", "woken", r.event.other);
+                break;
+            case Kind::awaited:
+                if (awaited.insert(r.event.other).second) write(r, r.event.other, "s", "await", "await");
+                break;
+            case Kind::done:
+                if (suspended.erase(co)) write(r, co, "e", "coroutine", "suspended");
+                write(r, co, "n", "coroutine", "done");
+                if (awaited.erase(co)) write(r, co, "f", "await", "await");
+                break;
+            case Kind::destroyed:
+                if (suspended.erase(co)) write(r, co, "e", "coroutine", "suspended");
+                awaited.erase(co);
+                write(r, co, "e", "coroutine", name);
+                names.erase(co);
+                break;
+        }
+    }
+    out << "\n]}\n";
+}
+
+}  // namespace promise::trace
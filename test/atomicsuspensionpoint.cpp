@@ -0,0 +1,84 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "atomic_suspension_point.h"
+#include "event_loop.h"
+// clang-format on
+
+#include <atomic>
+#include <thread>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class AtomicSuspensionTest : public testing::Test {
+   public:
+    AtomicSuspensionTest() { living.clear(); }
+    ~AtomicSuspensionTest() { EXPECT_TRUE(living.empty()); }
+
+    AtomicSuspensionPoint<int> point;
+    AtomicSuspensionPoint<void> void_point;
+    long long sum = 0;
+    atomic<int> received{};
+    thread::id resumed_on;
+
+    Promise<int> inner() { co_return co_await point; }
+    Promise<void> receiver(int n) {
+        for (int i = 0; i < n; i++) {
+            sum += co_await inner();
+            received++;
+        }
+        resumed_on = this_thread::get_id();
+    }
+    Promise<void> void_receiver() {
+        co_await void_point;
+        received++;
+    }
+};
+
+TEST_F(AtomicSuspensionTest, resumeBeforeAwait) {
+    point.resume(3);
+    EXPECT_TRUE(point.notified_before());
+    auto p = receiver(1);
+    p->start();
+    EXPECT_TRUE(p->done());
+    EXPECT_EQ(sum, 3);
+    EXPECT_FALSE(point.notified_before());
+}
+
+TEST_F(AtomicSuspensionTest, resumeAfterSuspend) {
+    auto p = receiver(2);
+    p->start();
+    point.resume(1);
+    EXPECT_EQ(received, 1);
+    point.resume(2);
+    EXPECT_TRUE(p->done());
+    EXPECT_EQ(sum, 3);
+}
+
+TEST_F(AtomicSuspensionTest, voidPoint) {
+    auto p = void_receiver();
+    p->start();
+    EXPECT_FALSE(p->done());
+    void_point.resume();
+    EXPECT_TRUE(p->done());
+}
+
+// Another thread resumes while the chain suspends, every value arrives once and on the thread of the loop
+TEST_F(AtomicSuspensionTest, crossThreadRace) {
+    constexpr int n = 20000;
+    EventLoop loop;
+    auto p = receiver(n);
+    loop.spawn(p);
+    thread notifier([&] {
+        for (int i = 0; i < n; i++) {
+            while (received < i) this_thread::yield();
+            point.resume(i);
+        }
+    });
+    loop.run_until([&] { return p->done(); });
+    notifier.join();
+    EXPECT_EQ(sum, (long long) n * (n - 1) / 2);
+    EXPECT_EQ(resumed_on, this_thread::get_id());
+}
@@ -0,0 +1,81 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "backtrace.h"
+// clang-format on
+
+#include <sstream>
+#include <string>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class BacktraceTest : public testing::Test {
+   public:
+    BacktraceTest() { living.clear(); }
+    ~BacktraceTest() { EXPECT_TRUE(living.empty()); }
+
+    SuspensionPoint<void> point;
+
+    Promise<void> inner() { co_await point; }
+    Promise<void> middle() { co_await inner(); }
+    Promise<void> outer() { co_await middle(); }
+    Promise<void, int> yielding() { co_yield 1; }
+};
+
+TEST_F(BacktraceTest, suspendedChain) {
+    auto p = outer();
+    p->start();
+    auto chains = backtrace::chains();
+    ASSERT_EQ(chains.size(), 1);
+    auto& chain = chains[0];
+    ASSERT_EQ(chain.size(), 3);
+    EXPECT_NE(string(chain[0].function).find("BacktraceTest::inner"), string::npos);
+    EXPECT_NE(string(chain[1].function).find("BacktraceTest::middle"), string::npos);
+    EXPECT_NE(string(chain[2].function).find("BacktraceTest::outer"), string::npos);
+    EXPECT_EQ(chain[0].state, backtrace::State::waiting);
+    EXPECT_EQ(chain[1].state, backtrace::State::awaiting);
+    EXPECT_EQ(chain[2].coroutine, static_cast<const Coroutine*>(p.operator->()));
+    for (size_t i = 0; i < chain.size(); i++) {
+        EXPECT_EQ(chain[i].depth, i);
+        EXPECT_EQ(chain[i].waiting_on, &point);
+    }
+    point.resume();
+    chains = backtrace::chains();
+    ASSERT_EQ(chains.size(), 1);
+    EXPECT_EQ(chains[0].size(), 1);
+    EXPECT_EQ(chains[0][0].state, backtrace::State::done);
+}
+
+TEST_F(BacktraceTest, separateChains) {
+    auto a = outer();
+    auto b = yielding();
+    auto c = yielding();
+    b->start();
+    auto chains = backtrace::chains();
+    ASSERT_EQ(chains.size(), 3);
+    int created = 0, yielded = 0;
+    for (auto& chain : chains) {
+        EXPECT_EQ(chain.size(), 1);
+        created += chain[0].state == backtrace::State::created;
+        yielded += chain[0].state == backtrace::State::yielded;
+    }
+    EXPECT_EQ(created, 2);
+    EXPECT_EQ(yielded, 1);
+}
+
+TEST_F(BacktraceTest, dump) {
+    auto p = outer();
+    p->start();
+    ostringstream out;
+    backtrace::dump(out);
+    auto s = out.str();
+    EXPECT_EQ(s.rfind("chain 0: waiting on ", 0), 0);
+    auto inner = s.find("#0 "), middle = s.find("#1 "), outer = s.find("#2 ");
+    ASSERT_NE(outer, string::npos);
+    EXPECT_LT(inner, middle);
+    EXPECT_LT(middle, outer);
+    EXPECT_NE(s.find("BacktraceTest::inner", inner), string::npos);
+    point.resume();
+}
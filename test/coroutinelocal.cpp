@@ -0,0 +1,158 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "event_loop.h"
+#include "parallel_map.h"
+#include "promise.h"
+// clang-format on
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+static const Local<int> request_id;
+static const Local<string> user;
+
+class CoroutineLocalTest : public testing::Test {
+   public:
+    CoroutineLocalTest() { living.clear(); }
+    ~CoroutineLocalTest() { EXPECT_TRUE(living.empty()); }
+
+    vector<SuspensionPoint<void>> points{2};
+
+    Promise<int> inner(int i) {
+        co_await points[i];
+        int* id = co_await request_id;
+        co_return id ? *id : -1;
+    }
+    Promise<int> middle(int i) { co_return co_await inner(i) + 1; }
+    Promise<int> outer(int i = 0) { co_return co_await middle(i); }
+
+    Promise<string> setter() {
+        co_await user.set("alice");
+        co_return *co_await user;
+    }
+    Promise<string> reader() {
+        auto name = co_await user;
+        co_return name ? *name : "nobody";
+    }
+    vector<int> range_ids;
+    Promise<void> record_id() {
+        int* id = co_await request_id;
+        range_ids.push_back(id ? *id : -1);
+    }
+    Promise<void> range_reader() {
+        co_await request_id.set(7);
+        vector<Promise<void>> readers;
+        for (int i = 0; i < 2; i++) readers.push_back(record_id());
+        co_await readers;
+    }
+    Promise<string> set_then_read() {
+        co_await user.set("bob");
+        co_return co_await reader();
+    }
+    Promise<string> nested_setter() {
+        co_await user.set("carol");
+        co_return co_await reader();
+    }
+    vector<string> seen;
+    Promise<void> nested_sets() {
+        string* name = &co_await user.set("alice");
+        seen.push_back(co_await nested_setter());
+        seen.push_back(co_await reader());
+        seen.push_back(*name);
+        co_await user.set("dave");
+        seen.push_back(*name);
+    }
+    Promise<int> element(int x) {
+        int* parent = co_await request_id;
+        co_await request_id.set(x);
+        this_thread::sleep_for(chrono::microseconds(10));
+        co_return parent && *parent == 7 ? *co_await request_id : -1;
+    }
+    vector<int> mapped;
+    Promise<void> map_with_locals(ThreadPool& pool) {
+        co_await request_id.set(7);
+        vector<int> input(100);
+        for (int i = 0; i < 100; i++) input[i] = i;
+        mapped = co_await parallel_map(pool, input, [this](int x) { return element(x); });
+        mapped.push_back(*co_await request_id);
+    }
+};
+
+TEST_F(CoroutineLocalTest, inheritedThroughAwaits) {
+    auto p = outer();
+    p->set(request_id, 7);
+    p->start();
+    points[0].resume();
+    EXPECT_EQ(*p->returned_value(), 8);
+}
+
+TEST_F(CoroutineLocalTest, unsetIsNull) {
+    auto p = outer();
+    p->start();
+    points[0].resume();
+    EXPECT_EQ(*p->returned_value(), 0);
+    EXPECT_EQ(p->get(request_id), nullptr);
+}
+
+TEST_F(CoroutineLocalTest, setInsideCoroutine) {
+    auto p = setter();
+    p->start();
+    EXPECT_EQ(*p->returned_value(), "alice");
+    ASSERT_NE(p->get(user), nullptr);
+    EXPECT_EQ(*p->get(user), "alice");
+    EXPECT_EQ(p->get(request_id), nullptr);
+}
+
+TEST_F(CoroutineLocalTest, calleesSeeCallerValues) {
+    auto p = set_then_read();
+    p->start();
+    EXPECT_EQ(*p->returned_value(), "bob");
+    auto q = reader();
+    q->start();
+    EXPECT_EQ(*q->returned_value(), "nobody");
+}
+
+TEST_F(CoroutineLocalTest, inheritedByRangeAwait) {
+    range_reader()->start();
+    EXPECT_EQ(range_ids, (vector<int>{7, 7}));
+}
+
+TEST_F(CoroutineLocalTest, chainsAreSeparate) {
+    auto a = outer(0);
+    auto b = outer(1);
+    a->set(request_id, 1);
+    b->set(request_id, 2);
+    a->start();
+    b->start();
+    points[1].resume();
+    points[0].resume();
+    EXPECT_EQ(*a->returned_value(), 2);
+    EXPECT_EQ(*b->returned_value(), 3);
+}
+
+// A value set by a callee is only seen by it and what it awaits, not by its caller or the callees that follow
+TEST_F(CoroutineLocalTest, nestedSetStaysInCallee) {
+    nested_sets()->start();
+    EXPECT_EQ(seen, (vector<string>{"carol", "alice", "alice", "dave"}));
+}
+
+// Elements on the threads of the pool set their own values while they read the one of the caller
+TEST_F(CoroutineLocalTest, concurrentSetsInParallelMap) {
+    EventLoop loop;
+    {
+        ThreadPool pool(4);
+        auto p = map_with_locals(pool);
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+    }
+    ASSERT_EQ(mapped.size(), 101);
+    for (int i = 0; i < 100; i++) EXPECT_EQ(mapped[i], i);
+    EXPECT_EQ(mapped.back(), 7);
+}
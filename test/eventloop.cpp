@@ -0,0 +1,363 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "event_loop.h"
+#include "task_group.h"
+// clang-format on
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class EventLoopTest : public testing::Test {
+   public:
+    EventLoopTest() { living.clear(); }
+    ~EventLoopTest() { EXPECT_TRUE(living.empty()); }
+
+    EventLoop loop;
+    SuspensionPoint<int> point;
+    vector<SuspensionPoint<void>> points{3};
+    vector<string> log;
+
+    Promise<void> receiver() {
+        int x = co_await point;
+        log.push_back("received " + to_string(x));
+    }
+    Promise<int> nested_receiver() { co_return co_await point; }
+    Promise<void> outer_receiver() {
+        int x = co_await nested_receiver();
+        log.push_back("nested " + to_string(x));
+    }
+    Promise<void> waiter(int i) {
+        co_await points[i];
+        log.push_back("waiter " + to_string(i));
+    }
+    Promise<void> notifier() {
+        for (int i = 0; i < 3; i++) points[i].resume();
+        log.push_back("notified");
+        co_return;
+    }
+    // Two coroutines that wake each other up, resuming inline would nest every wake up on the stack
+    SuspensionPoint<void> ping_point, pong_point;
+    int rounds = 0;
+    bool finished = false;
+    Promise<void> ping(int n) {
+        for (int i = 0; i < n; i++) {
+            if (pong_point) pong_point.resume();
+            co_await ping_point;
+            rounds++;
+        }
+        finished = true;
+        if (pong_point) pong_point.resume();
+    }
+    Promise<void> pong() {
+        while (!finished) {
+            if (ping_point) ping_point.resume();
+            co_await pong_point;
+        }
+    }
+    Promise<void> logger(string name) {
+        log.push_back(name);
+        co_return;
+    }
+    int rounds_seen = -1;
+    Promise<void> observer() {
+        rounds_seen = rounds;
+        co_return;
+    }
+    Promise<void> awaiting(Promise<void>& callee) { co_await callee; }
+    Promise<int> ready(int i) { co_return i; }
+    // Only awaits coroutines that finish right away, so it never suspends by itself
+    long long sum = 0;
+    Promise<void> hot(int n) {
+        for (int i = 0; i < n; i++) sum += co_await ready(i);
+        log.push_back("hot");
+    }
+    Promise<void> polite(string name) {
+        for (int i = 0; i < 3; i++) {
+            log.push_back(name + " " + to_string(i));
+            co_await yield_now();
+        }
+    }
+    Promise<void> nested_polite(string name) { co_await polite(name); }
+    Promise<void> starts_inline(Promise<void> child) {
+        Coroutine& self = co_await this_coroutine;
+        child->inherit(self);
+        child->start();
+        log.push_back("parent");
+    }
+    Promise<void> polite_group() {
+        TaskGroup group;
+        co_await group.spawn(polite("a"));
+        co_await group.spawn(nested_polite("b"));
+        co_await group.join();
+        log.push_back("joined");
+    }
+    EventLoop other;
+    Promise<void> hopping() {
+        log.push_back("before");
+        co_await resume_on(other);
+        log.push_back("after");
+        co_await point;
+        log.push_back("woken");
+    }
+    Promise<void> nested_hopping() {
+        co_await hopping();
+        log.push_back("outer");
+    }
+    Promise<void> waiting_logger(string name) {
+        co_await point;
+        log.push_back(name);
+    }
+    Promise<void> range_waiter() {
+        vector<Promise<void>> waiters;
+        for (int i = 0; i < 2; i++) waiters.push_back(waiter(i));
+        co_await waiters;
+        log.push_back("all");
+    }
+    int counted = 0;
+    Promise<void> count_one() {
+        counted++;
+        co_return;
+    }
+};
+
+TEST_F(EventLoopTest, resumptionIsPosted) {
+    loop.spawn(receiver());
+    EXPECT_EQ(loop.size(), 1);
+    EXPECT_EQ(loop.run(), 1);
+    EXPECT_TRUE(log.empty());
+    point.resume(3);
+    EXPECT_TRUE(log.empty());
+    EXPECT_EQ(loop.size(), 1);
+    EXPECT_EQ(loop.run_once(), 1);
+    EXPECT_EQ(log, vector<string>{"received 3"});
+    EXPECT_TRUE(loop.empty());
+}
+
+TEST_F(EventLoopTest, awaitedCoroutinesInheritLoop) {
+    auto p = outer_receiver();
+    loop.spawn(p);
+    loop.run();
+    point.resume(4);
+    EXPECT_TRUE(log.empty());
+    loop.run();
+    EXPECT_EQ(log, vector<string>{"nested 4"});
+    EXPECT_TRUE(p->done());
+}
+
+TEST_F(EventLoopTest, fifoBatches) {
+    for (int i = 0; i < 3; i++) loop.spawn(waiter(i));
+    loop.spawn(notifier());
+    EXPECT_EQ(loop.run_once(), 4);
+    EXPECT_EQ(log, vector<string>{"notified"});
+    EXPECT_EQ(loop.size(), 3);
+    EXPECT_EQ(loop.run_once(), 3);
+    EXPECT_EQ(log, (vector<string>{"notified", "waiter 0", "waiter 1", "waiter 2"}));
+    EXPECT_EQ(loop.peak_size(), 4);
+    EXPECT_EQ(loop.resumed(), 7);
+    EXPECT_EQ(loop.batches(), 2);
+}
+
+TEST_F(EventLoopTest, boundedStack) {
+    constexpr int n = 100000;
+    auto p = ping(n);
+    auto q = pong();
+    loop.spawn(q);
+    loop.spawn(p);
+    loop.run();
+    EXPECT_EQ(rounds, n);
+    EXPECT_TRUE(p->done());
+    EXPECT_TRUE(q->done());
+}
+
+// The elements of a range await are bound to the loop of the chain that awaits them
+TEST_F(EventLoopTest, rangeAwaitElementsArePosted) {
+    auto p = range_waiter();
+    loop.spawn(p, Priority::high);
+    loop.run();
+    points[0].resume();
+    EXPECT_TRUE(log.empty());
+    EXPECT_EQ(loop.size(Priority::high), 1);
+    points[1].resume();
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"waiter 0", "waiter 1", "all"}));
+    EXPECT_TRUE(p->done());
+}
+
+TEST_F(EventLoopTest, unboundCoroutinesResumeInline) {
+    auto p = receiver();
+    p->start();
+    point.resume(5);
+    EXPECT_EQ(log, vector<string>{"received 5"});
+    EXPECT_TRUE(loop.empty());
+}
+
+TEST_F(EventLoopTest, higherPriorityRunsFirst) {
+    loop.spawn(logger("background"), Priority::background);
+    loop.spawn(logger("normal"));
+    loop.spawn(logger("high"), Priority::high);
+    EXPECT_EQ(loop.size(Priority::background), 1);
+    EXPECT_EQ(loop.size(), 3);
+    EXPECT_EQ(loop.run(), 3);
+    EXPECT_EQ(log, (vector<string>{"high", "normal", "background"}));
+    EXPECT_EQ(loop.batches(), 3);
+}
+
+TEST_F(EventLoopTest, starvationGuard) {
+    EventLoop loop(4);
+    constexpr int n = 100;
+    auto p = ping(n);
+    auto q = pong();
+    loop.spawn(q, Priority::high);
+    loop.spawn(p, Priority::high);
+    loop.spawn(observer(), Priority::background);
+    loop.run();
+    EXPECT_EQ(rounds, n);
+    EXPECT_GE(rounds_seen, 0);
+    EXPECT_LT(rounds_seen, 4);
+}
+
+TEST_F(EventLoopTest, calleesInheritPriority) {
+    auto p = outer_receiver();
+    loop.spawn(p, Priority::background);
+    loop.spawn(logger("normal"));
+    loop.run();
+    point.resume(1);
+    loop.spawn(logger("normal"));
+    EXPECT_EQ(loop.size(Priority::background), 1);
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"normal", "normal", "nested 1"}));
+}
+
+TEST_F(EventLoopTest, explicitPriorityIsKept) {
+    auto callee = waiting_logger("callee");
+    callee->set_priority(Priority::high);
+    auto p = awaiting(callee);
+    loop.spawn(p, Priority::background);
+    loop.run();
+    EXPECT_EQ(callee->priority(), Priority::high);
+    loop.spawn(logger("normal"));
+    point.resume(2);
+    EXPECT_EQ(loop.size(Priority::high), 1);
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"callee", "normal"}));
+    EXPECT_TRUE(p->done());
+}
+
+TEST_F(EventLoopTest, budgetYieldsHotCoroutine) {
+    loop.set_budget(10);
+    auto p = hot(100);
+    loop.spawn(p);
+    loop.spawn(logger("other"));
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"other", "hot"}));
+    EXPECT_EQ(sum, 4950);
+    EXPECT_EQ(loop.yields(), 10);
+    EXPECT_TRUE(p->done());
+}
+
+TEST_F(EventLoopTest, budgetYieldsInlineStarted) {
+    loop.set_budget(10);
+    loop.spawn(starts_inline(hot(100)));
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"parent", "hot"}));
+    EXPECT_EQ(sum, 4950);
+    EXPECT_EQ(loop.yields(), 10);
+}
+
+TEST_F(EventLoopTest, unlimitedBudget) {
+    loop.set_budget(0);
+    loop.spawn(hot(100));
+    loop.spawn(logger("other"));
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"hot", "other"}));
+    EXPECT_EQ(loop.yields(), 0);
+}
+
+TEST_F(EventLoopTest, yieldNow) {
+    loop.spawn(polite("a"));
+    loop.spawn(nested_polite("b"));
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"a 0", "b 0", "a 1", "b 1", "a 2", "b 2"}));
+    EXPECT_EQ(loop.yields(), 6);
+}
+
+// The child is not awaited, it is queued again itself instead of the root the loop resumed
+TEST_F(EventLoopTest, yieldNowInlineStarted) {
+    loop.spawn(starts_inline(polite("a")));
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"a 0", "parent", "a 1", "a 2"}));
+    EXPECT_EQ(loop.yields(), 3);
+}
+
+TEST_F(EventLoopTest, yieldNowInTaskGroup) {
+    loop.spawn(polite_group());
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"a 0", "b 0", "a 1", "b 1", "a 2", "b 2", "joined"}));
+    EXPECT_EQ(loop.yields(), 6);
+}
+
+TEST_F(EventLoopTest, yieldNowWithoutLoop) {
+    auto p = polite("a");
+    p->start();
+    EXPECT_TRUE(p->done());
+    EXPECT_EQ(log.size(), 3);
+}
+
+TEST_F(EventLoopTest, resumeOnMovesChain) {
+    auto p = nested_hopping();
+    loop.spawn(p);
+    loop.run();
+    EXPECT_EQ(log, vector<string>{"before"});
+    EXPECT_EQ(other.size(), 1);
+    EXPECT_EQ(p->executor(), &other);
+    other.run();
+    EXPECT_EQ(log, (vector<string>{"before", "after"}));
+    point.resume(1);
+    EXPECT_TRUE(loop.empty());
+    EXPECT_EQ(other.size(), 1);
+    other.run();
+    EXPECT_EQ(log, (vector<string>{"before", "after", "woken", "outer"}));
+    EXPECT_TRUE(p->done());
+}
+
+TEST_F(EventLoopTest, resumeOnWithoutExecutor) {
+    auto p = hopping();
+    p->start();
+    EXPECT_EQ(log, vector<string>{"before"});
+    other.run();
+    EXPECT_EQ(log, (vector<string>{"before", "after"}));
+    point.resume(1);
+    other.run();
+    EXPECT_TRUE(p->done());
+}
+
+TEST_F(EventLoopTest, remotePostsKeepOrder) {
+    thread([&] {
+        for (auto name : {"a", "b", "c"}) loop.spawn(logger(name));
+    }).join();
+    EXPECT_TRUE(loop.empty());  // Still in the remote queue until the next batch
+    EXPECT_EQ(loop.run(), 3);
+    EXPECT_EQ(log, (vector<string>{"a", "b", "c"}));
+}
+
+TEST_F(EventLoopTest, remotePostsWakeSleepingLoop) {
+    vector<thread> posters;
+    for (int i = 0; i < 4; i++) {
+        posters.emplace_back([&] {
+            for (int j = 0; j < 1000; j++) {
+                if (j % 100 == 0) this_thread::sleep_for(chrono::microseconds(200));
+                loop.spawn(count_one());
+            }
+        });
+    }
+    loop.run_until([&] { return counted == 4000; });
+    for (auto& poster : posters) poster.join();
+    EXPECT_EQ(counted, 4000);
+}
@@ -0,0 +1,111 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "file_io.h"
+#include "event_loop.h"
+// clang-format on
+
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class FileIoTest : public testing::Test {
+   public:
+    FileIoTest() { living.clear(); }
+    ~FileIoTest() {
+        // The reads and writes on io_pool() finish right after they resumed their waiter
+        for (int i = 0; i < 1000 && !living.empty(); i++) this_thread::sleep_for(chrono::milliseconds(1));
+        EXPECT_TRUE(living.empty());
+    }
+
+    EventLoop loop;
+    string path = testing::TempDir() + "promise_file_io_test";
+    string contents;
+    vector<size_t> sizes;
+    thread::id consumed_on;
+    string error;
+
+    static span<const byte> bytes(const string& s) { return as_bytes(span(s)); }
+
+    Promise<void> read_all(size_t chunk_size) {
+        auto chunks = io::read_file_chunks(path, chunk_size);
+        while (auto chunk = co_await pull(chunks)) {
+            contents.append(reinterpret_cast<const char*>(chunk->data()), chunk->size());
+            sizes.push_back(chunk->size());
+            consumed_on = this_thread::get_id();
+        }
+    }
+    Promise<void> write_then_read(string data, size_t chunk_size) {
+        co_await io::async_write_file(path, bytes(data));
+        co_await read_all(chunk_size);
+    }
+    Promise<void> append_then_read(string first, string second) {
+        co_await io::async_write_file(path, bytes(first));
+        co_await io::async_write_file(path, bytes(second), true);
+        co_await read_all(1024);
+    }
+    Promise<void> read_missing() {
+        try {
+            co_await read_all(16);
+        } catch (const system_error& e) {
+            error = e.code() == errc::no_such_file_or_directory ? "missing" : e.what();
+        }
+    }
+    void run(Promise<void> p) {
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+        if (p->exception()) rethrow_exception(p->exception());
+    }
+};
+
+TEST_F(FileIoTest, chunksInOrder) {
+    string data;
+    for (int i = 0; i < 1000; i++) data += to_string(i) + ",";
+    run(write_then_read(data, 256));
+    EXPECT_EQ(contents, data);
+    ASSERT_EQ(sizes.size(), (data.size() + 255) / 256);
+    for (size_t i = 0; i + 1 < sizes.size(); i++) EXPECT_EQ(sizes[i], 256);
+    EXPECT_EQ(consumed_on, this_thread::get_id());
+}
+
+TEST_F(FileIoTest, exactMultipleOfChunk) {
+    run(write_then_read(string(64, 'x'), 16));
+    EXPECT_EQ(sizes, (vector<size_t>{16, 16, 16, 16}));
+}
+
+TEST_F(FileIoTest, emptyFile) {
+    run(write_then_read("", 16));
+    EXPECT_TRUE(sizes.empty());
+}
+
+TEST_F(FileIoTest, append) {
+    run(append_then_read("hello ", "world"));
+    EXPECT_EQ(contents, "hello world");
+}
+
+TEST_F(FileIoTest, writeOutlivesDroppedPromise) {
+    static const string data(1 << 20, 'x');
+    {
+        auto write = io::async_write_file(path, bytes(data));
+        loop.spawn(write);
+        loop.run_once();
+    }
+    // The write keeps its own state and finishes without a waiter
+    for (int i = 0; i < 1000 && !living.empty(); i++) this_thread::sleep_for(chrono::milliseconds(1));
+    run(read_all(64 * 1024));
+    EXPECT_EQ(contents.size(), data.size());
+}
+
+TEST_F(FileIoTest, missingFileThrows) {
+    path += "_missing";
+    run(read_missing());
+    EXPECT_EQ(error, "missing");
+}
@@ -0,0 +1,77 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "frame_pool.h"
+#include "promise.h"
+// clang-format on
+
+#include <thread>
+
+using namespace promise;
+using namespace std;
+
+using promise::detail::FramePool;
+
+static auto& living = promise::Coroutine::living;
+
+class FramePoolTest : public testing::Test {
+   public:
+    FramePoolTest() { living.clear(); }
+    ~FramePoolTest() { EXPECT_TRUE(living.empty()); }
+
+    FramePool pool;
+
+    Promise<int> answer() { co_return 42; }
+};
+
+TEST_F(FramePoolTest, reusesBySizeClass) {
+    void* a = pool.allocate(100);
+    pool.deallocate(a, 100);
+    EXPECT_EQ(pool.cached(), 1);
+    EXPECT_EQ(pool.allocate(120), a);  // Same class of 128 bytes
+    EXPECT_EQ(pool.cached(), 0);
+    void* b = pool.allocate(20);
+    EXPECT_NE(b, a);
+    pool.deallocate(a, 120);
+    pool.deallocate(b, 20);
+    EXPECT_EQ(pool.cached(), 2);
+}
+
+TEST_F(FramePoolTest, largeFramesAreNotCached) {
+    void* a = pool.allocate(FramePool::max_size + 1);
+    pool.deallocate(a, FramePool::max_size + 1);
+    EXPECT_EQ(pool.cached(), 0);
+}
+
+TEST_F(FramePoolTest, cacheIsBounded) {
+    void* frames[FramePool::max_cached + 1];
+    for (auto& frame : frames) frame = pool.allocate(64);
+    for (auto& frame : frames) pool.deallocate(frame, 64);
+    EXPECT_EQ(pool.cached(), FramePool::max_cached);
+}
+
+TEST_F(FramePoolTest, coroutineFrames) {
+    FramePool::Scope scope(pool);
+    EXPECT_EQ(FramePool::local(), &pool);
+    {
+        auto p = answer();
+        p->start();
+        EXPECT_EQ(p->returned_value(), 42);
+    }
+    EXPECT_EQ(pool.cached(), 1);
+    auto p = answer();
+    EXPECT_EQ(pool.cached(), 0);
+}
+
+// A frame of the pool may be freed on a thread without one and the other way round
+TEST_F(FramePoolTest, framesMoveBetweenThreads) {
+    void* mine = pool.allocate(200);
+    void* foreign = nullptr;
+    thread([&] {
+        EXPECT_EQ(FramePool::local(), nullptr);
+        foreign = promise::detail::allocate_frame(200);
+        promise::detail::free_frame(mine, 200);
+    }).join();
+    pool.deallocate(foreign, 200);
+    EXPECT_EQ(pool.allocate(200), foreign);
+    pool.deallocate(foreign, 200);
+}
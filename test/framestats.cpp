@@ -0,0 +1,136 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "frame_stats.h"
+#include "promise.h"
+// clang-format on
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class FrameStatsTest : public testing::Test {
+   public:
+    FrameStatsTest() { living.clear(); }
+    ~FrameStatsTest() { EXPECT_TRUE(living.empty()); }
+
+    SuspensionPoint<void> point;
+
+    Promise<void> suspending() { co_await point; }
+
+    static frames::FunctionStats find(const string& part) {
+        for (auto& f : frames::snapshot()) {
+            if (f.function.find(part) != string::npos) return f;
+        }
+        return {};
+    }
+};
+
+static source_location frame_site() { return source_location::current(); }
+
+TEST_F(FrameStatsTest, allocations) {
+    auto loc = frame_site();
+    auto before = frames::totals();
+    void* a = frames::detail::allocate(100, loc);
+    void* b = frames::detail::allocate(100, loc);
+    auto stats = find("frame_site");
+    EXPECT_EQ(stats.line, loc.line());
+    EXPECT_EQ(stats.frame_size, 100 + frames::detail::header_size);
+    EXPECT_EQ(stats.allocations, 2);
+    EXPECT_EQ(stats.live, 2);
+    EXPECT_EQ(stats.peak_live, 2);
+    EXPECT_EQ(frames::totals().live_bytes, before.live_bytes + 2 * stats.frame_size);
+    frames::detail::deallocate(a, 100);
+    frames::detail::deallocate(b, 100);
+    stats = find("frame_site");
+    EXPECT_EQ(stats.allocations, 2);
+    EXPECT_EQ(stats.live, 0);
+    EXPECT_EQ(stats.peak_live, 2);
+    EXPECT_EQ(frames::totals().live_bytes, before.live_bytes);
+    EXPECT_GE(frames::totals().peak_bytes, before.live_bytes + 2 * stats.frame_size);
+}
+
+TEST_F(FrameStatsTest, countsOfFinishedThreadsAreKept) {
+    auto loc = frame_site();
+    uint64_t before = find("frame_site").allocations;
+    thread([&]() { frames::detail::deallocate(frames::detail::allocate(8, loc), 8); }).join();
+    EXPECT_EQ(find("frame_site").allocations, before + 1);
+}
+
+// Every thread counts in its own shard, a frame freed on another thread still leaves the merged live count right
+TEST_F(FrameStatsTest, freedOnAnotherThread) {
+    auto loc = frame_site();
+    auto before = find("frame_site");
+    auto bytes = frames::totals().live_bytes;
+    void* a = frames::detail::allocate(32, loc);
+    void* b = frames::detail::allocate(32, loc);
+    thread([&]() {
+        frames::detail::deallocate(a, 32);
+        frames::detail::deallocate(b, 32);
+    }).join();
+    auto after = find("frame_site");
+    EXPECT_EQ(after.allocations, before.allocations + 2);
+    EXPECT_EQ(after.live, before.live);
+    EXPECT_GE(after.peak_live, 2);
+    EXPECT_EQ(frames::totals().live_bytes, bytes);
+}
+
+TEST_F(FrameStatsTest, livingList) {
+    auto p = suspending();
+    auto q = suspending();
+    EXPECT_EQ(living.size(), 2);
+    int started = 0;
+    p->start();
+    living.for_each([&](const Coroutine& c) { started += c.started(); });
+    EXPECT_EQ(started, 1);
+    point.resume();
+    EXPECT_TRUE(p->done());
+}
+
+TEST_F(FrameStatsTest, coroutineFrames) {
+    if (!frames::enabled) GTEST_SKIP() << "Frames are only accounted with PROMISE_FRAME_STATS";
+    {
+        auto p = suspending();
+        auto q = suspending();
+        auto stats = find("FrameStatsTest::suspending");
+        EXPECT_EQ(stats.live, 2);
+        EXPECT_GT(stats.frame_size, sizeof(Coroutine));
+        ostringstream out;
+        frames::dump(out);
+        EXPECT_NE(out.str().find("FrameStatsTest::suspending"), string::npos);
+    }
+    EXPECT_EQ(find("FrameStatsTest::suspending").live, 0);
+}
+
+// Every thread links into its own segment of the list, objects may be destroyed on another thread or after their
+// thread finished
+TEST_F(FrameStatsTest, livingListAcrossThreads) {
+    vector<Promise<void>> promises;
+    mutex promises_mutex;
+    vector<thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < 100; j++) {
+                auto p = suspending();
+                if (j % 10 == 0) {
+                    lock_guard lock(promises_mutex);
+                    promises.push_back(p);
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(living.size(), 40);
+    size_t seen = 0;
+    living.for_each([&](const Coroutine&) { seen++; });
+    EXPECT_EQ(seen, 40);
+    while (promises.size() > 20) promises.pop_back();
+    EXPECT_EQ(living.size(), 20);
+    thread([&]() { promises.clear(); }).join();
+    EXPECT_TRUE(living.empty());
+}
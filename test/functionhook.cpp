@@ -5,10 +5,21 @@
 // clang-format on
 
 #include <array>
+#include <memory>
+#include <string>
+#include <vector>
 using namespace std;
 
 #define TEST_HOOK(R, ...) NON_BLOCKING_HOOK(R, ObservableFunctionTest, __VA_ARGS__)
 
+struct CountingArg {
+    inline static int copies = 0;
+    std::string payload = std::string(1024, 'x');
+    CountingArg() = default;
+    CountingArg(const CountingArg& other) : payload(other.payload) { copies++; }
+    CountingArg(CountingArg&&) = default;
+};
+
 class ObservableFunctionTest : public testing::Test {
    public:
     enum FunctionNames {
@@ -40,6 +51,9 @@ class ObservableFunctionTest : public testing::Test {
     TEST_HOOK(void, arg_post_hook, int, int, int);
     TEST_HOOK(void, result_post_hook, int);
     TEST_HOOK(int, ambiguous_hook, int);
+    TEST_HOOK(void, counted_hook, CountingArg);
+    TEST_HOOK(int, subscribing_hook, string);
+    vector<string> post_hook_strings;
 };
 
 void ObservableFunctionTest::empty_hook::impl() {
@@ -86,6 +100,17 @@ int ObservableFunctionTest::ambiguous_hook::impl(int r) {
     return 2 * r;
 }
 
+void ObservableFunctionTest::counted_hook::impl(CountingArg arg) {
+    self->hook_value = (int) arg.payload.size();
+}
+
+int ObservableFunctionTest::subscribing_hook::impl(string s) {
+    if (postHooks.empty()) {
+        postHooks += [this](const int&, const string& arg) { self->post_hook_strings.push_back(arg); };
+    }
+    return (int) s.size();
+}
+
 TEST_F(ObservableFunctionTest, basic) {
     empty_hook();
     expected_counts[EMPTY_HOOK]++;
@@ -206,3 +231,164 @@ TEST_F(ObservableFunctionTest, noArghookedArg) {
     EXPECT_EQ(hook_value, 5);
     EXPECT_EQ(p, 5);
 }
+
+TEST_F(ObservableFunctionTest, unsubscribe) {
+    auto token = empty_hook.preHooks += empty_hook_hook;
+    empty_hook.postHooks += empty_hook_hook;
+    EXPECT_TRUE(token.subscribed());
+    token.unsubscribe();
+    EXPECT_FALSE(token.subscribed());
+    empty_hook();
+    expected_counts[EMPTY_HOOK]++;
+    expected_counts[EMPTY_HOOK_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+}
+
+TEST_F(ObservableFunctionTest, scopedSubscription) {
+    {
+        Subscription sub = arg_hook.preHooks += arg_hook_hook;
+        arg_hook(2, 3);
+        expected_counts[ARG_HOOK_HOOK]++;
+        expected_counts[ARG_HOOK]++;
+        EXPECT_EQ(function_counts, expected_counts);
+    }
+    arg_hook(2, 3);
+    expected_counts[ARG_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+}
+
+TEST_F(ObservableFunctionTest, staleToken) {
+    auto first = empty_hook.preHooks += empty_hook_hook;
+    first.unsubscribe();
+    auto second = empty_hook.preHooks += empty_hook_hook;
+    first.unsubscribe();
+    EXPECT_FALSE(first.subscribed());
+    EXPECT_TRUE(second.subscribed());
+    empty_hook();
+    expected_counts[EMPTY_HOOK_HOOK]++;
+    expected_counts[EMPTY_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+}
+
+TEST_F(ObservableFunctionTest, unsubscribeDuringDispatch) {
+    Subscription self_removing;
+    HookToken next;
+    int self_count = 0;
+    self_removing = empty_hook.preHooks += [&]() {
+        self_count++;
+        self_removing.unsubscribe();
+        next.unsubscribe();
+        empty_hook.preHooks += empty_hook_hook;
+    };
+    next = empty_hook.preHooks += waiting_hook_hook;
+    empty_hook();
+    expected_counts[EMPTY_HOOK]++;
+    EXPECT_EQ(self_count, 1);
+    EXPECT_EQ(function_counts, expected_counts);
+
+    empty_hook();
+    expected_counts[EMPTY_HOOK_HOOK]++;
+    expected_counts[EMPTY_HOOK]++;
+    EXPECT_EQ(self_count, 1);
+    EXPECT_EQ(function_counts, expected_counts);
+}
+
+TEST_F(ObservableFunctionTest, manySubscriptions) {
+    std::vector<Subscription> subs;
+    for (int i = 0; i < 100; i++) subs.push_back(empty_hook.preHooks += empty_hook_hook);
+    for (int i = 0; i < 100; i += 2) subs[i].unsubscribe();
+    empty_hook();
+    expected_counts[EMPTY_HOOK_HOOK] += 50;
+    expected_counts[EMPTY_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+    for (int i = 1; i < 100; i += 2) EXPECT_TRUE(subs[i].subscribed());
+    subs.clear();
+    empty_hook();
+    expected_counts[EMPTY_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+}
+
+TEST_F(ObservableFunctionTest, subscriptionOutlivesObservable) {
+    Subscription sub;
+    {
+        auto observable = make_unique<ObservableFunction<int, int>>([](int x) { return x; });
+        sub = observable->preHooks += empty_hook_hook;
+        EXPECT_TRUE(sub.subscribed());
+    }
+    EXPECT_FALSE(sub.subscribed());
+    sub.unsubscribe();
+}
+
+TEST_F(ObservableFunctionTest, copyDoesNotShareTokens) {
+    ObservableFunction<int, int> original([](int x) { return x; });
+    auto token = original.preHooks += empty_hook_hook;
+    ObservableFunction<int, int> copy = original;
+    token.unsubscribe();
+    original(1);
+    EXPECT_EQ(function_counts, expected_counts);
+    copy(1);
+    expected_counts[EMPTY_HOOK_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+}
+
+TEST_F(ObservableFunctionTest, assignmentDoesNotShareTokens) {
+    ObservableFunction<int, int> original([](int x) { return x; });
+    ObservableFunction<int, int> assigned([](int x) { return -x; });
+    auto token = original.preHooks += empty_hook_hook;
+    auto stale = assigned.preHooks += empty_hook_hook;
+    assigned = original;
+    EXPECT_FALSE(stale.subscribed());
+    token.unsubscribe();
+    EXPECT_EQ(assigned(2), 2);
+    expected_counts[EMPTY_HOOK_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+}
+
+TEST_F(ObservableFunctionTest, argumentCopies) {
+    for (int i = 0; i < 5; i++) {
+        counted_hook.preHooks += [](const CountingArg& arg) { EXPECT_EQ(arg.payload.size(), 1024); };
+    }
+    CountingArg::copies = 0;
+    counted_hook(CountingArg{});
+    EXPECT_EQ(CountingArg::copies, 0);
+    EXPECT_EQ(hook_value, 1024);
+
+    counted_hook.postHooks += [](const CountingArg& arg) { EXPECT_EQ(arg.payload.size(), 1024); };
+    CountingArg::copies = 0;
+    counted_hook(CountingArg{});
+    EXPECT_EQ(CountingArg::copies, 1);
+
+    CountingArg arg;
+    CountingArg::copies = 0;
+    counted_hook(arg);
+    EXPECT_EQ(CountingArg::copies, 2);
+}
+
+// The first call moved its argument into the impl, so the post hook subscribed there only sees the next call
+TEST_F(ObservableFunctionTest, postHookSubscribedDuringCall) {
+    EXPECT_EQ(subscribing_hook(string(100, 'y')), 100);
+    EXPECT_TRUE(post_hook_strings.empty());
+    EXPECT_EQ(subscribing_hook(string(100, 'z')), 100);
+    EXPECT_EQ(post_hook_strings, vector<string>{string(100, 'z')});
+}
+
+TEST_F(ObservableFunctionTest, runtimeImpl) {
+    ObservableFunction<int, int, int> runtime([this](int a, int b) { return arg_hook(a, b); }, "runtime");
+    runtime.preHooks += arg_hook_hook;
+    EXPECT_EQ(runtime(1, 2), 3);
+    EXPECT_EQ(hook_value, 3);
+    expected_counts[ARG_HOOK]++;
+    expected_counts[ARG_HOOK_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+}
+
+// Code written against ObservableFunction subscribes to and calls NON_BLOCKING_HOOK objects like runtime observables
+TEST_F(ObservableFunctionTest, hookThroughBaseReference) {
+    ObservableFunction<int, int, int>& base = arg_hook;
+    base.preHooks += arg_hook_hook;
+    EXPECT_EQ(base(2, 3), 5);
+    EXPECT_EQ(hook_value, 5);
+    expected_counts[ARG_HOOK_HOOK]++;
+    expected_counts[ARG_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+}
@@ -2,14 +2,27 @@
 #include <gtest/gtest.h>
 #define GLOBAL_PROMISE
 #include "hook.h"
+#include "event_loop.h"
 // clang-format on
 
 #include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
 using namespace std;
 
 #define TEST_HOOK(R, ...) HOOK(R, void, ObservablePromiseTest, __VA_ARGS__)
 
 static auto& living = promise::Coroutine::living;
+static const promise::Local<int> request_id;
+struct CountingPromiseArg {
+    inline static int copies = 0;
+    std::string payload = std::string(1024, 'x');
+    CountingPromiseArg() = default;
+    CountingPromiseArg(const CountingPromiseArg& other) : payload(other.payload) { copies++; }
+    CountingPromiseArg(CountingPromiseArg&&) = default;
+};
+
 class ObservablePromiseTest : public testing::Test {
    public:
     enum FunctionNames {
@@ -44,6 +57,22 @@ class ObservablePromiseTest : public testing::Test {
     TEST_HOOK(void, arg_post_hook, int, int, int);
     TEST_HOOK(void, result_post_hook, int);
     TEST_HOOK(int, ambiguous_hook, int);
+    TEST_HOOK(void, counted_hook, CountingPromiseArg);
+    TEST_HOOK(int, waiting_string_hook, string);
+    TEST_HOOK(int, context_hook);
+
+    // What the synchronous part of a hooked call sees of the chain that awaits it
+    struct Context {
+        int id = -1;
+        Executor* executor = nullptr;
+        Priority priority = Priority::normal;
+    };
+    static Promise<Context> context() {
+        promise::Coroutine& self = co_await this_coroutine;
+        int* id = co_await request_id;
+        co_return Context{id ? *id : -1, self.executor(), self.priority()};
+    }
+    Context impl_context, hook_context;
 };
 
 Promise<void> ObservablePromiseTest::empty_hook::impl() {
@@ -96,6 +125,21 @@ Promise<int> ObservablePromiseTest::ambiguous_hook::impl(int r) {
     co_return 2 * r;
 }
 
+Promise<void> ObservablePromiseTest::counted_hook::impl(CountingPromiseArg arg) {
+    self->hook_value = (int) arg.payload.size();
+    co_return;
+}
+
+Promise<int> ObservablePromiseTest::context_hook::impl() {
+    self->impl_context = co_await context();
+    co_return self->impl_context.id;
+}
+
+Promise<int> ObservablePromiseTest::waiting_string_hook::impl(string s) {
+    co_await self->point;
+    co_return (int) s.size();
+}
+
 TEST_F(ObservablePromiseTest, basic) {
     auto p = empty_hook();
     EXPECT_EQ(living.size(), 1);
@@ -290,3 +334,197 @@ TEST_F(ObservablePromiseTest, noArghookedArg) {
     EXPECT_TRUE(p->done());
     EXPECT_EQ(p->returned_value(), 5);
 }
+
+TEST_F(ObservablePromiseTest, unsubscribe) {
+    auto token = empty_hook.preHooks += empty_hook_hook;
+    empty_hook.postHooks += empty_hook_hook;
+    token.unsubscribe();
+    EXPECT_FALSE(token.subscribed());
+    auto p = empty_hook();
+    p->start();
+    expected_counts[EMPTY_HOOK]++;
+    expected_counts[EMPTY_HOOK_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+    EXPECT_TRUE(p->done());
+}
+
+TEST_F(ObservablePromiseTest, scopedSubscription) {
+    {
+        Subscription sub = arg_hook.postHooks += arg_post_hook;
+        auto p = arg_hook(3, 8);
+        p->start();
+        expected_counts[ARG_HOOK]++;
+        expected_counts[ARG_POST_HOOK]++;
+        EXPECT_EQ(function_counts, expected_counts);
+    }
+    auto p = arg_hook(3, 8);
+    p->start();
+    expected_counts[ARG_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+    EXPECT_EQ(p->returned_value(), 11);
+}
+
+TEST_F(ObservablePromiseTest, unsubscribeWhileSuspended) {
+    empty_hook.preHooks += waiting_hook_hook;
+    auto token = empty_hook.preHooks += empty_hook_hook;
+    auto p = empty_hook();
+    p->start();
+    expected_counts[WAITING_HOOK_HOOK_0]++;
+    EXPECT_EQ(function_counts, expected_counts);
+
+    token.unsubscribe();
+    empty_hook.preHooks += empty_hook_hook;
+    point.resume();
+    expected_counts[WAITING_HOOK_HOOK_1]++;
+    expected_counts[EMPTY_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+    EXPECT_TRUE(p->done());
+
+    auto q = empty_hook();
+    q->start();
+    expected_counts[WAITING_HOOK_HOOK_0]++;
+    point.resume();
+    expected_counts[WAITING_HOOK_HOOK_1]++;
+    expected_counts[EMPTY_HOOK_HOOK]++;
+    expected_counts[EMPTY_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+    EXPECT_TRUE(q->done());
+}
+
+TEST_F(ObservablePromiseTest, argumentCopies) {
+    for (int i = 0; i < 5; i++) {
+        counted_hook.preHooks += [](const CountingPromiseArg& arg) -> Promise<void> {
+            EXPECT_EQ(arg.payload.size(), 1024);
+            co_return;
+        };
+    }
+    CountingPromiseArg::copies = 0;
+    counted_hook(CountingPromiseArg{})->start();
+    EXPECT_EQ(CountingPromiseArg::copies, 0);
+    EXPECT_EQ(hook_value, 1024);
+
+    counted_hook.postHooks += [](const CountingPromiseArg& arg) -> Promise<void> {
+        EXPECT_EQ(arg.payload.size(), 1024);
+        co_return;
+    };
+    CountingPromiseArg::copies = 0;
+    counted_hook(CountingPromiseArg{})->start();
+    EXPECT_EQ(CountingPromiseArg::copies, 1);
+
+    CountingPromiseArg arg;
+    CountingPromiseArg::copies = 0;
+    counted_hook(arg)->start();
+    EXPECT_EQ(CountingPromiseArg::copies, 2);
+}
+
+// The first call moved its argument into the impl, the post hook subscribed while it was suspended starts with the next
+TEST_F(ObservablePromiseTest, postHookSubscribedDuringCall) {
+    vector<string> seen;
+    auto p = waiting_string_hook(string(100, 'y'));
+    p->start();
+    waiting_string_hook.postHooks += [&](const int& r, const string& s) -> Promise<void> {
+        EXPECT_EQ(r, 100);
+        seen.push_back(s);
+        co_return;
+    };
+    point.resume();
+    EXPECT_EQ(p->returned_value(), 100);
+    EXPECT_TRUE(seen.empty());
+    auto q = waiting_string_hook(string(100, 'z'));
+    q->start();
+    point.resume();
+    EXPECT_EQ(q->returned_value(), 100);
+    EXPECT_EQ(seen, vector<string>{string(100, 'z')});
+}
+
+// Also with PROMISE_HOOK_STATS, where the impl and hooks are started before they are awaited to time them
+TEST_F(ObservablePromiseTest, chainReachesImpl) {
+    context_hook.preHooks += [this]() -> Promise<void> { hook_context = co_await context(); };
+    EventLoop loop;
+    auto caller = [this]() -> Promise<int> {
+        co_await request_id.set(42);
+        co_return co_await context_hook();
+    };
+    auto p = caller();
+    loop.spawn(p, Priority::high);
+    loop.run();
+    EXPECT_EQ(p->returned_value(), 42);
+    for (auto& seen : {impl_context, hook_context}) {
+        EXPECT_EQ(seen.id, 42);
+        EXPECT_EQ(seen.executor, &loop);
+        EXPECT_EQ(seen.priority, Priority::high);
+    }
+}
+
+// Code written against ObservablePromise subscribes to and calls HOOK objects like runtime observables
+static Promise<int> call_observable(ObservablePromise<int, void, int, int>& observable, int a, int b) {
+    co_return co_await observable(a, b);
+}
+TEST_F(ObservablePromiseTest, hookThroughBaseReference) {
+    ObservablePromise<int, void, int, int>& base = arg_hook;
+    base.preHooks += arg_hook_hook;
+    auto p = call_observable(base, 2, 3);
+    p->start();
+    EXPECT_EQ(p->returned_value(), 5);
+    EXPECT_EQ(hook_value, 5);
+    expected_counts[ARG_HOOK_HOOK]++;
+    expected_counts[ARG_HOOK]++;
+    EXPECT_EQ(function_counts, expected_counts);
+
+    ObservablePromise<int, void, int, int> runtime([](int a, int b) -> Promise<int> { co_return a * b; });
+    auto q = call_observable(runtime, 2, 3);
+    q->start();
+    EXPECT_EQ(q->returned_value(), 6);
+    auto copy = runtime;
+    auto r = call_observable(copy, 4, 3);
+    r->start();
+    EXPECT_EQ(r->returned_value(), 12);
+}
+
+// Assignment copies like the copy constructor, the tokens stay with the list that gave them out
+TEST_F(ObservablePromiseTest, assignment) {
+    ObservablePromise<int, void, int, int> sum([](int a, int b) -> Promise<int> { co_return a + b; });
+    ObservablePromise<int, void, int, int> product([](int a, int b) -> Promise<int> { co_return a * b; });
+    int sum_hooks = 0, product_hooks = 0;
+    auto sum_token = sum.preHooks += [&](const int&, const int&) -> Promise<void> {
+        sum_hooks++;
+        co_return;
+    };
+    auto product_token = product.preHooks += [&](const int&, const int&) -> Promise<void> {
+        product_hooks++;
+        co_return;
+    };
+    product = sum;
+    EXPECT_TRUE(sum_token.subscribed());
+    EXPECT_FALSE(product_token.subscribed());
+    product_token.unsubscribe();  // Addresses the same slot as sum_token, but no longer reaches the list
+    auto p = call_observable(product, 2, 3);
+    p->start();
+    EXPECT_EQ(p->returned_value(), 5);
+    EXPECT_EQ(sum_hooks, 1);
+    EXPECT_EQ(product_hooks, 0);
+    sum_token.unsubscribe();
+    auto q = call_observable(product, 2, 3);
+    q->start();
+    EXPECT_EQ(sum_hooks, 2);
+    auto r = call_observable(sum, 2, 3);
+    r->start();
+    EXPECT_EQ(sum_hooks, 2);
+}
+
+// A list that dispatches keeps its hooks, the dispatch visits them
+TEST_F(ObservablePromiseTest, assignmentDuringDispatch) {
+    ObservablePromise<int, void, int, int> sum([](int a, int b) -> Promise<int> { co_return a + b; });
+    ObservablePromise<int, void, int, int> other = sum;
+    sum.preHooks += [&](const int&, const int&) -> Promise<void> {
+        sum.preHooks = other.preHooks;
+        co_return;
+    };
+    auto p = call_observable(sum, 2, 3);
+    p->start();
+    EXPECT_THROW(rethrow_exception(p->exception()), logic_error);
+    EXPECT_FALSE(sum.preHooks.empty());
+}
+
+// Hook objects carry no std::function, only the empty box a runtime impl would live in
+static_assert(sizeof(promise::detail::ImplBox<ObservablePromise<int, void, int>::Impl>) == sizeof(void*));
@@ -0,0 +1,203 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "functionhook.h"
+#include "hook.h"
+#include "hook_stats.h"
+#include "promise.h"
+// clang-format on
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class HookStatsTest : public testing::Test {
+   public:
+    HookStatsTest() { living.clear(); }
+    ~HookStatsTest() { EXPECT_TRUE(living.empty()); }
+
+    SuspensionPoint<void> point;
+
+    Promise<void> suspending() { co_await point; }
+    Promise<int> immediate() { co_return 1; }
+
+    static stats::SiteStats find(const string& name) {
+        for (auto& site : stats::snapshot()) {
+            if (site.name == name) return site;
+        }
+        return {};
+    }
+};
+
+class Observed {
+   public:
+    HOOK(int, void, Observed, fetch, int);
+    NON_BLOCKING_HOOK(int, Observed, count, int);
+};
+Promise<int> Observed::fetch::impl(int x) { co_return x + 1; }
+int Observed::count::impl(int x) { return x + 1; }
+
+TEST(Histogram, buckets) {
+    EXPECT_EQ(stats::Histogram::bucket(0), 0);
+    EXPECT_EQ(stats::Histogram::bucket(1), 1);
+    EXPECT_EQ(stats::Histogram::bucket(1000), 10);
+    EXPECT_EQ(stats::Histogram::bucket(1023), 10);
+    EXPECT_EQ(stats::Histogram::bucket(1024), 11);
+    EXPECT_EQ(stats::Histogram::bucket(UINT64_MAX), 64);
+    stats::Histogram h;
+    EXPECT_EQ(h.quantile(0.5), 0);
+    h.buckets[3] = 9;
+    h.buckets[10] = 1;
+    EXPECT_EQ(h.count(), 10);
+    EXPECT_EQ(h.quantile(0.5), 7);
+    EXPECT_EQ(h.quantile(0.9), 7);
+    EXPECT_EQ(h.quantile(1), 1023);
+}
+
+TEST_F(HookStatsTest, synchronousCalls) {
+    stats::RecordingSite site("HookStatsTest::sync");
+    auto f = [](int x) { return x + 1; };
+    EXPECT_EQ(site.call(f, 1), 2);
+    EXPECT_EQ(site.call(f, 2), 3);
+    auto stats = find("HookStatsTest::sync");
+    EXPECT_EQ(stats.calls, 2);
+    EXPECT_EQ(stats.sync.count(), 2);
+    EXPECT_EQ(stats.suspended.count(), 0);
+}
+
+TEST_F(HookStatsTest, promiseCalls) {
+    stats::RecordingSite site("HookStatsTest::promise");
+    auto p = immediate();
+    auto timing = site.start(p);
+    EXPECT_TRUE(p->done());
+    timing.finish();
+
+    auto q = suspending();
+    auto suspended_timing = site.start(q);
+    EXPECT_FALSE(q->done());
+    point.resume();
+    EXPECT_TRUE(q->done());
+    suspended_timing.finish();
+
+    auto stats = find("HookStatsTest::promise");
+    EXPECT_EQ(stats.calls, 2);
+    EXPECT_EQ(stats.sync.count(), 2);
+    EXPECT_EQ(stats.suspended.count(), 1);
+}
+
+TEST_F(HookStatsTest, awaitStartedPromise) {
+    stats::RecordingSite site("HookStatsTest::awaited");
+    auto outer = [&, this]() -> Promise<void> {
+        auto call = suspending();
+        auto timing = site.start(call);
+        co_await call;
+        timing.finish();
+    };
+    auto p = outer();
+    p->start();
+    EXPECT_FALSE(p->done());
+    point.resume();
+    EXPECT_TRUE(p->done());
+    EXPECT_EQ(find("HookStatsTest::awaited").suspended.count(), 1);
+}
+
+TEST_F(HookStatsTest, mergesThreadsAndNames) {
+    stats::RecordingSite site("HookStatsTest::threads");
+    stats::RecordingSite copy = site;
+    auto f = []() {};
+    thread t([&]() { site.call(f); });
+    t.join();
+    copy.call(f);
+    auto stats = find("HookStatsTest::threads");
+    EXPECT_EQ(stats.calls, 2);
+
+    ostringstream out;
+    stats::dump(out);
+    EXPECT_NE(out.str().find("HookStatsTest::threads calls=2"), string::npos);
+}
+
+TEST_F(HookStatsTest, removedSites) {
+    {
+        stats::RecordingSite site("HookStatsTest::removed");
+        auto f = []() {};
+        site.call(f);
+        EXPECT_EQ(find("HookStatsTest::removed").calls, 1);
+    }
+    EXPECT_EQ(find("HookStatsTest::removed").name, "");
+}
+
+// Ids of removed sites are reused with cleared counters, churning sites does not grow the tables
+TEST_F(HookStatsTest, reusesSiteIds) {
+    auto f = []() {};
+    size_t capacity = stats::detail::registry().capacity();
+    for (int i = 0; i < 1000; i++) {
+        stats::RecordingSite site("HookStatsTest::churn");
+        site.call(f);
+        EXPECT_EQ(find("HookStatsTest::churn").calls, 1);
+    }
+    EXPECT_LE(stats::detail::registry().capacity(), capacity + 1);
+}
+
+// A Timing that finishes after its site was destroyed does not count for the next site in the same slot
+TEST_F(HookStatsTest, lateTimingIsDropped) {
+    stats::RecordingSite::Timing timing;
+    {
+        stats::RecordingSite site("HookStatsTest::late");
+        auto p = suspending();
+        timing = site.start(p);
+        point.resume();
+    }
+    stats::RecordingSite next("HookStatsTest::next");
+    timing.finish();
+    EXPECT_EQ(find("HookStatsTest::next").suspended.count(), 0);
+}
+
+TEST_F(HookStatsTest, namedByHookMacros) {
+    if (!stats::enabled) GTEST_SKIP() << "Hooks are only measured with PROMISE_HOOK_STATS";
+    Observed observed;
+    observed.fetch.preHooks += []() -> Promise<void> { co_return; };
+    observed.fetch.postHooks.resultHook([](const int&) -> Promise<void> { co_return; });
+    observed.count.preHooks += []() {};
+    observed.count.postHooks.resultHook([](const int&) {});
+    observed.count.postHooks.resultHook([](const int&) {});
+    observed.fetch(1)->start();
+    observed.count(1);
+    observed.count(2);
+
+    EXPECT_EQ(find("Observed::fetch").calls, 1);
+    EXPECT_EQ(find("Observed::fetch.pre#0").calls, 1);
+    EXPECT_EQ(find("Observed::fetch.post#0").calls, 1);
+    EXPECT_EQ(find("Observed::count").calls, 2);
+    EXPECT_EQ(find("Observed::count.pre#0").calls, 2);
+    EXPECT_EQ(find("Observed::count.post#1").calls, 2);
+    ostringstream out;
+    stats::dump(out);
+    for (auto name : {"Observed::fetch calls=1", "Observed::fetch.pre#0 calls=1", "Observed::count.post#0 calls=2"}) {
+        EXPECT_NE(out.str().find(name), string::npos) << name;
+    }
+}
+
+TEST_F(HookStatsTest, unnamedObservablesAreDistinct) {
+    if (!stats::enabled) GTEST_SKIP() << "Hooks are only measured with PROMISE_HOOK_STATS";
+    ObservableFunction<int, int> first([](int x) { return x; });
+    ObservableFunction<int, int> second([](int x) { return x; });
+    first.preHooks += []() {};
+    second.preHooks += []() {};
+    first(1);
+    second(1);
+    second(2);
+    uint64_t most = 0;
+    size_t unnamed = 0;
+    for (auto& site : stats::snapshot()) {
+        if (site.name.starts_with("ObservableFunction@")) {
+            unnamed++;
+            most = max(most, site.calls);
+        }
+    }
+    EXPECT_EQ(unnamed, 4);
+    EXPECT_EQ(most, 2);
+}
@@ -0,0 +1,87 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "mapped_file.h"
+// clang-format on
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class MappedFileTest : public testing::Test {
+   public:
+    MappedFileTest() { living.clear(); }
+    ~MappedFileTest() { EXPECT_TRUE(living.empty()); }
+
+    string path = testing::TempDir() + "promise_mapped_file_test";
+    void write(const string& contents) { ofstream(path, ios::binary) << contents; }
+
+    static vector<string> collect(Promise<void, string_view> generator) {
+        vector<string> values;
+        generator->start();
+        while (!generator->done()) {
+            values.emplace_back(*generator->yielded_value());
+            generator->resume();
+        }
+        if (generator->exception()) rethrow_exception(generator->exception());
+        return values;
+    }
+    size_t longest = 0;
+    Promise<int> count_lines() {
+        auto generator = io::mapped_lines(path);
+        int count = 0;
+        while (auto line = co_await pull(generator)) {
+            longest = max(longest, line->size());
+            count++;
+        }
+        co_return count;
+    }
+};
+
+TEST_F(MappedFileTest, lines) {
+    write("first\nsecond\n\nlast");
+    EXPECT_EQ(collect(io::mapped_lines(path)), (vector<string>{"first", "second", "", "last"}));
+    write("one\ntwo\n");
+    EXPECT_EQ(collect(io::mapped_lines(path)), (vector<string>{"one", "two"}));
+}
+
+TEST_F(MappedFileTest, emptyFile) {
+    write("");
+    EXPECT_TRUE(collect(io::mapped_lines(path)).empty());
+}
+
+TEST_F(MappedFileTest, records) {
+    write("aaaabbbbcc");
+    EXPECT_EQ(collect(io::mapped_records(path, 4)), (vector<string>{"aaaa", "bbbb", "cc"}));
+}
+
+TEST_F(MappedFileTest, viewsPointIntoMapping) {
+    write("x,y");
+    io::MappedFile file(path);
+    auto generator = io::lines(file.view(), ',');
+    generator->start();
+    EXPECT_EQ(generator->yielded_value()->data(), file.view().data());
+    generator->resume();
+    EXPECT_EQ(generator->yielded_value()->data(), file.view().data() + 2);
+}
+
+TEST_F(MappedFileTest, pulledLines) {
+    string contents;
+    for (int i = 0; i < 10000; i++) contents += string(i % 100, 'x') + "\n";
+    write(contents);
+    auto p = count_lines();
+    p->start();
+    EXPECT_EQ(*p->returned_value(), 10000);
+    EXPECT_EQ(longest, 99);
+}
+
+TEST_F(MappedFileTest, missingFile) {
+    EXPECT_THROW(io::MappedFile(path + "_missing"), system_error);
+    EXPECT_THROW(collect(io::mapped_lines(path + "_missing")), system_error);
+}
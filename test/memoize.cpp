@@ -0,0 +1,163 @@
+// clang-format off
+#include <gtest/gtest.h>
+#define GLOBAL_PROMISE
+#include "memoize.h"
+// clang-format on
+
+#include <array>
+#include <stdexcept>
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class MemoizeTest : public testing::Test {
+   public:
+    MemoizeTest() { living.clear(); }
+    ~MemoizeTest() { EXPECT_TRUE(living.empty()); }
+
+    int calls = 0;
+    int pre_hook_calls = 0;
+    SuspensionPoint<void> point;
+
+    MEMOIZED_HOOK(int, void, MemoizeTest, square, 2, int);
+    MEMOIZED_HOOK(int, void, MemoizeTest, slow_square, 2, int);
+    MEMOIZED_HOOK(int, void, MemoizeTest, slow_failure, 2, int);
+
+    Promise<int> nested_slow_square(int x) { co_return co_await slow_square(x); }
+};
+
+Promise<int> MemoizeTest::square::impl(int x) {
+    self->calls++;
+    co_return x * x;
+}
+
+Promise<int> MemoizeTest::slow_square::impl(int x) {
+    self->calls++;
+    co_await self->point;
+    co_return x * x;
+}
+
+Promise<int> MemoizeTest::slow_failure::impl(int x) {
+    self->calls++;
+    co_await self->point;
+    throw invalid_argument(to_string(x));
+}
+
+TEST_F(MemoizeTest, cachesResults) {
+    auto p = square(3);
+    p->start();
+    EXPECT_EQ(p->returned_value(), 9);
+    auto q = square(3);
+    q->start();
+    EXPECT_EQ(q->returned_value(), 9);
+    EXPECT_EQ(calls, 1);
+    auto r = square(4);
+    r->start();
+    EXPECT_EQ(r->returned_value(), 16);
+    EXPECT_EQ(calls, 2);
+}
+
+TEST_F(MemoizeTest, hooksStillRun) {
+    static_assert(is_base_of_v<BasicObservablePromise<decltype(square), int, void, int>, decltype(square)>);
+    square.preHooks += [this](const int&) -> Promise<void> {
+        pre_hook_calls++;
+        co_return;
+    };
+    square(3)->start();
+    square(3)->start();
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(pre_hook_calls, 2);
+}
+
+TEST_F(MemoizeTest, evictsLeastRecentlyUsed) {
+    square(1)->start();
+    square(2)->start();
+    square(1)->start();
+    square(3)->start();
+    EXPECT_EQ(calls, 3);
+    square(1)->start();
+    EXPECT_EQ(calls, 3);
+    square(2)->start();
+    EXPECT_EQ(calls, 4);
+}
+
+TEST_F(MemoizeTest, singleFlight) {
+    array<Promise<int>, 3> promises = {slow_square(5), slow_square(5), slow_square(5)};
+    for (auto& p : promises) p->start();
+    EXPECT_EQ(calls, 1);
+    for (auto& p : promises) EXPECT_FALSE(p->done());
+    point.resume();
+    for (auto& p : promises) {
+        EXPECT_TRUE(p->done());
+        EXPECT_EQ(p->returned_value(), 25);
+    }
+    auto cached = slow_square(5);
+    cached->start();
+    EXPECT_TRUE(cached->done());
+    EXPECT_EQ(calls, 1);
+}
+
+// A caller whose Promise is dropped while it waits for the shared call neither blocks the others nor leaks
+TEST_F(MemoizeTest, joinedCallerDroppedBeforeLanding) {
+    auto leader = slow_square(6);
+    leader->start();
+    {
+        auto dropped = slow_square(6);
+        dropped->start();
+    }
+    auto joined = slow_square(6);
+    joined->start();
+    EXPECT_EQ(calls, 1);
+    point.resume();
+    EXPECT_EQ(leader->returned_value(), 36);
+    EXPECT_EQ(joined->returned_value(), 36);
+    auto cached = slow_square(6);
+    cached->start();
+    EXPECT_EQ(cached->returned_value(), 36);
+    EXPECT_EQ(calls, 1);
+}
+
+// Everyone who joined the failing call sees its exception, the next call tries again
+TEST_F(MemoizeTest, singleFlightException) {
+    array<Promise<int>, 3> promises = {slow_failure(5), slow_failure(5), slow_failure(5)};
+    for (auto& p : promises) p->start();
+    EXPECT_EQ(calls, 1);
+    point.resume();
+    for (auto& p : promises) {
+        EXPECT_TRUE(p->done());
+        EXPECT_THROW(rethrow_exception(p->exception()), invalid_argument);
+    }
+    auto again = slow_failure(5);
+    again->start();
+    EXPECT_EQ(calls, 2);
+    point.resume();
+    EXPECT_TRUE(again->exception());
+}
+
+TEST_F(MemoizeTest, differentArgumentsDoNotShare) {
+    auto p = slow_square(2);
+    p->start();
+    auto q = nested_slow_square(3);
+    EXPECT_EQ(calls, 1);
+    point.resume();
+    q->start();
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(p->returned_value(), 4);
+    point.resume();
+    EXPECT_EQ(q->returned_value(), 9);
+}
+
+TEST_F(MemoizeTest, decorator) {
+    int impl_calls = 0;
+    auto memo = promise::memoize<int, void, int>(
+        [&](int x) -> Promise<int> {
+            impl_calls++;
+            co_return x + 1;
+        },
+        0);
+    memo(1)->start();
+    memo(1)->start();
+    EXPECT_EQ(impl_calls, 2);
+    EXPECT_EQ(memo.size(), 0);
+    EXPECT_EQ(memo.in_flight(), 0);
+}
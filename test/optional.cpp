@@ -104,6 +104,55 @@ TEST_F(UnassignableTest, replaceUnassignable) {
     EXPECT_EQ(dtor_count, 1);
 }
 
+struct Moved {
+    const int x;
+    inline static int copies = 0;
+    inline static int moves = 0;
+    Moved(int x) : x(x) {}
+    Moved(const Moved& other) : x(other.x) { copies++; }
+    Moved(Moved&& other) : x(other.x) { moves++; }
+};
+
+TEST(Optional, moveAssignMoves) {
+    optional<Moved> x{1};
+    optional<Moved> y{};
+    Moved::copies = Moved::moves = 0;
+    y = std::move(x);
+    EXPECT_EQ(y->x, 1);
+    EXPECT_EQ(Moved::copies, 0);
+    EXPECT_EQ(Moved::moves, 1);
+}
+
+struct ConstInt {
+    const int x;
+};
+
+// These optionals are stored in every coroutine frame, so their layout matters
+static_assert(sizeof(optional<int&>) == sizeof(int*));
+static_assert(std::is_trivially_copyable_v<optional<int&>>);
+static_assert(std::is_trivially_copyable_v<optional<int>>);
+static_assert(std::is_trivially_copyable_v<optional<ConstInt>>);
+static_assert(std::is_trivially_destructible_v<optional<ConstInt>>);
+static_assert(sizeof(optional<ConstInt>) == sizeof(std::optional<int>));
+static_assert(std::is_trivially_copyable_v<optional<void>>);
+static_assert(sizeof(optional<void>) == sizeof(bool));
+static_assert(!std::is_trivially_copyable_v<optional<Unassignable>>);
+
+TEST(Optional, trivialUnassignable) {
+    optional<ConstInt> x{};
+    EXPECT_FALSE(x);
+    std::move(x) = ConstInt{2};
+    EXPECT_EQ(x->x, 2);
+    optional<ConstInt> y = x;
+    std::move(x) = ConstInt{3};
+    EXPECT_EQ(y->x, 2);
+    EXPECT_EQ(x->x, 3);
+    x = y;
+    EXPECT_EQ(x->x, 2);
+    x.reset();
+    EXPECT_FALSE(x);
+}
+
 TEST(Optional, emptyReference) {
     optional<int&> x;
     optional<int&> y;
@@ -0,0 +1,137 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "parallel_map.h"
+#include "event_loop.h"
+// clang-format on
+
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class ParallelMapTest : public testing::Test {
+   public:
+    ParallelMapTest() {
+        living.clear();
+        for (int i = 0; i < 100; i++) input[i] = i;
+    }
+    ~ParallelMapTest() { EXPECT_TRUE(living.empty()); }
+
+    EventLoop loop;
+    vector<int> input = vector<int>(100);
+    vector<int> output;
+    thread::id resumed_on;
+    mutex threads_mutex;
+    set<thread::id> threads;
+
+    int square(int x) {
+        {
+            lock_guard lock(threads_mutex);
+            threads.insert(this_thread::get_id());
+        }
+        this_thread::sleep_for(chrono::microseconds(100));
+        return x * x;
+    }
+    Promise<int> square_async(int x) { co_return square(x); }
+    Promise<void> map(ThreadPool& pool, size_t max_parallelism) {
+        output = co_await parallel_map(pool, input, [&](int x) { return square(x); }, max_parallelism);
+        resumed_on = this_thread::get_id();
+    }
+    Promise<void> map_async(ThreadPool& pool) {
+        output = co_await parallel_map(pool, input, [&](int x) { return square_async(x); });
+        resumed_on = this_thread::get_id();
+    }
+    string error;
+    Promise<void> map_failing(ThreadPool& pool) {
+        try {
+            co_await parallel_map(pool, input, [&](int x) {
+                if (x == 50) throw runtime_error("element 50");
+                return x;
+            });
+        } catch (const runtime_error& e) {
+            error = e.what();
+        }
+    }
+    void check_output() {
+        ASSERT_EQ(output.size(), input.size());
+        for (int i = 0; i < 100; i++) EXPECT_EQ(output[i], i * i);
+        EXPECT_EQ(resumed_on, this_thread::get_id());
+    }
+};
+
+TEST_F(ParallelMapTest, resultsInOrder) {
+    {
+        ThreadPool pool(4);
+        auto p = map(pool, 0);
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+    }
+    check_output();
+    EXPECT_GT(threads.size(), 1);
+    EXPECT_FALSE(threads.count(this_thread::get_id()));
+}
+
+TEST_F(ParallelMapTest, coroutineElements) {
+    {
+        ThreadPool pool(4);
+        auto p = map_async(pool);
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+    }
+    check_output();
+}
+
+TEST_F(ParallelMapTest, limitedParallelism) {
+    {
+        ThreadPool pool(4);
+        auto p = map(pool, 1);
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+    }
+    check_output();
+    EXPECT_EQ(threads.size(), 1);
+}
+
+TEST_F(ParallelMapTest, firstErrorIsRethrown) {
+    {
+        ThreadPool pool(4);
+        auto p = map_failing(pool);
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+    }
+    EXPECT_EQ(error, "element 50");
+}
+
+TEST_F(ParallelMapTest, needsExecutor) {
+    ThreadPool pool(1);
+    auto p = map(pool, 0);
+    p->start();
+    EXPECT_TRUE(p->done());
+    EXPECT_TRUE(p->exception());
+    EXPECT_TRUE(output.empty());
+}
+
+// Every worker calls a copy of fn, a mutable lambda keeps its state on one thread
+TEST_F(ParallelMapTest, workersCopyFn) {
+    auto owned = [](ThreadPool& pool, vector<int>& input, vector<int>& output) -> Promise<void> {
+        output = co_await parallel_map(pool, input, [owner = thread::id()](int x) mutable {
+            if (owner == thread::id()) owner = this_thread::get_id();
+            this_thread::sleep_for(chrono::microseconds(10));
+            return owner == this_thread::get_id() ? x : -1;
+        });
+    };
+    {
+        ThreadPool pool(4);
+        auto p = owned(pool, input, output);
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+    }
+    EXPECT_EQ(output, input);
+}
@@ -0,0 +1,119 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "pipeline.h"
+#include "trace.h"
+// clang-format on
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class PipelineTest : public testing::Test {
+   public:
+    PipelineTest() { living.clear(); }
+    ~PipelineTest() { EXPECT_TRUE(living.empty()); }
+
+    int produced = 0;
+    SuspensionPoint<void> point;
+
+    Promise<void, int> numbers(int n) {
+        for (int i = 0; i < n; i++) {
+            produced++;
+            co_yield i;
+        }
+    }
+    Promise<void, int> waiting_numbers(int n) {
+        for (int i = 0; i < n; i++) {
+            co_await point;
+            co_yield i;
+        }
+    }
+    template <typename T> static vector<T> collect(Promise<void, T> generator) {
+        vector<T> values;
+        for (generator->start(); !generator->done(); generator->resume()) values.push_back(*generator->yielded_value());
+        return values;
+    }
+    // Resumptions of all coroutines while the generator is drained
+    template <typename T> static int resumptions(Promise<void, T> generator) {
+        trace::clear();
+        collect(std::move(generator));
+        int n = 0;
+        for (auto& recorded : trace::events()) n += recorded.event.kind == trace::Kind::resumed;
+        return n;
+    }
+    static Promise<void, int> pass_on(Promise<void, int> generator) { co_await generator; }
+    int sum = 0;
+    Promise<void> add_all(Promise<void, int> generator) {
+        while (auto value = co_await pull(generator)) sum += *value;
+    }
+};
+
+TEST_F(PipelineTest, stagesInOrder) {
+    Promise<void, int> p = numbers(100) | transform([](int x) { return x * x; }) |
+                           filter([](int x) { return x % 2 == 0; }) | take(3);
+    EXPECT_EQ(collect(p), (vector<int>{0, 4, 16}));
+    EXPECT_EQ(produced, 5);  // Nothing is pulled after the last element
+}
+
+TEST_F(PipelineTest, transformChangesType) {
+    Promise<void, string> p = numbers(3) | transform([](int x) { return to_string(x) + "!"; });
+    EXPECT_EQ(collect(p), (vector<string>{"0!", "1!", "2!"}));
+}
+
+TEST_F(PipelineTest, takeNothing) {
+    Promise<void, int> p = numbers(3) | take(0);
+    EXPECT_TRUE(collect(p).empty());
+    EXPECT_EQ(produced, 0);
+}
+
+TEST_F(PipelineTest, sourceEndsFirst) {
+    Promise<void, int> p = numbers(3) | filter([](int x) { return x != 1; }) | take(10);
+    EXPECT_EQ(collect(p), (vector<int>{0, 2}));
+}
+
+TEST_F(PipelineTest, suspendingSource) {
+    auto p = add_all(waiting_numbers(3) | transform([](int x) { return x + 10; }));
+    p->start();
+    for (int i = 0; i < 3; i++) {
+        EXPECT_FALSE(p->done());
+        point.resume();
+    }
+    EXPECT_TRUE(p->done());
+    EXPECT_EQ(sum, 33);
+}
+
+// The stages add no resumptions: an element costs what a coroutine that awaits the source costs, and a dropped one
+// never leaves the source
+TEST_F(PipelineTest, stagesRunInTheSource) {
+    if (!trace::enabled) GTEST_SKIP() << "Resumptions are counted by the trace points of PROMISE_TRACE";
+    constexpr int n = 10;
+    auto square = [](int x) { return x * x; };
+    auto any = [](int) { return true; };
+    auto none = [](int) { return false; };
+    int awaiting = resumptions(pass_on(numbers(n)));
+    EXPECT_EQ(resumptions<int>(numbers(n) | transform(square)), awaiting);
+    EXPECT_EQ(resumptions<int>(numbers(n) | transform(square) | filter(any) | transform(square)), awaiting);
+    EXPECT_EQ(resumptions<int>(numbers(n) | filter(none)), resumptions<int>(numbers(2 * n) | filter(none)));
+}
+
+TEST_F(PipelineTest, nestedSource) {
+    Promise<void, int> p = pass_on(numbers(10)) | filter([](int x) { return x % 3 == 0; }) | take(3);
+    EXPECT_EQ(collect(p), (vector<int>{0, 3, 6}));
+    EXPECT_EQ(produced, 7);
+}
+
+TEST_F(PipelineTest, stageThrows) {
+    auto p = add_all(numbers(5) | transform([](int x) {
+                         if (x == 3) throw invalid_argument("three");
+                         return x;
+                     }));
+    p->start();
+    EXPECT_TRUE(p->done());
+    EXPECT_THROW(rethrow_exception(p->exception()), invalid_argument);
+    EXPECT_EQ(sum, 3);
+}
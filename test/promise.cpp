@@ -4,6 +4,7 @@
 // clang-format on
 
 #include <array>
+#include <stdexcept>
 
 using namespace promise;
 using namespace std;
@@ -97,6 +98,53 @@ class PromiseTest : public testing::Test {
         co_await yield_void();
         co_yield 0;
     }
+    SuspensionPoint<void> throw_point;
+    Promise<int> throwing_after_suspension() {
+        co_await throw_point;
+        throw std::runtime_error("resumed");
+    }
+    Promise<int> passing_on() { co_return co_await throwing() + 1; }
+    Promise<int> throwing() {
+        throw std::runtime_error("thrown");
+        co_return 1;
+    }
+    Promise<void> throwing_void() {
+        throw std::runtime_error("thrown");
+        co_return;
+    }
+    Promise<int> catching() {
+        try {
+            co_return co_await throwing();
+        } catch (const std::runtime_error&) {
+            co_return 2;
+        }
+    }
+    SuspensionPoint<void> point;
+    Promise<void, long long> suspending_range(int max) {
+        for (int i = 0; i < max; i++) {
+            if (i == 1) co_await point;
+            co_yield i;
+        }
+    }
+    Promise<long long> sum_pulled(Promise<void, long long> generator) {
+        long long sum = 0;
+        while (auto value = co_await pull(generator)) sum += *value;
+        co_return sum;
+    }
+    Promise<void, int> failing_range() {
+        co_yield 1;
+        throw std::runtime_error("range");
+    }
+    Promise<int> count_until_error() {
+        auto generator = failing_range();
+        int count = 0;
+        try {
+            while (co_await pull(generator)) count++;
+        } catch (const std::runtime_error&) {
+            count += 10;
+        }
+        co_return count;
+    }
 };
 
 TEST_F(PromiseTest, emptyCoroutine) {
@@ -324,3 +372,69 @@ TEST_F(PromiseTest, discarded_coroutine) {
     std::ignore = empty_co();
     EXPECT_EQ(function_counts, expected_counts);
 }
+
+// An exception that escapes a coroutine used to be dropped, the coroutine then finished without a value. It is now
+// stored, start() and resume() do not throw, and the coroutine that awaits it rethrows it.
+TEST_F(PromiseTest, exceptionIsStoredNotThrown) {
+    auto p = throwing_after_suspension();
+    EXPECT_NO_THROW(p->start());
+    EXPECT_FALSE(p->exception());
+    EXPECT_NO_THROW(throw_point.resume());
+    EXPECT_TRUE(p->done());
+    EXPECT_FALSE(p->returned_value());
+    ASSERT_TRUE(p->exception());
+    EXPECT_THROW(std::rethrow_exception(p->exception()), std::runtime_error);
+}
+
+TEST_F(PromiseTest, uncaughtExceptionReachesRoot) {
+    auto p = passing_on();
+    p->start();
+    EXPECT_TRUE(p->done());
+    EXPECT_FALSE(p->returned_value());
+    EXPECT_TRUE(p->exception());
+}
+
+TEST_F(PromiseTest, exceptionPropagatesToAwaiter) {
+    auto p = throwing();
+    p->start();
+    EXPECT_TRUE(p->done());
+    EXPECT_TRUE(p->exception());
+    auto q = catching();
+    q->start();
+    EXPECT_EQ(*q->returned_value(), 2);
+    EXPECT_FALSE(q->exception());
+}
+
+// A void coroutine stores no return value, it returned if it finished without an exception
+TEST_F(PromiseTest, voidReturnedValue) {
+    auto p = empty_co();
+    EXPECT_FALSE(p->returned_value());
+    p->start();
+    EXPECT_TRUE(p->returned_value());
+    auto q = throwing_void();
+    q->start();
+    EXPECT_TRUE(q->done());
+    EXPECT_FALSE(q->returned_value());
+}
+
+TEST_F(PromiseTest, pullNestedYields) {
+    auto p = sum_pulled(nested_multiple());
+    p->start();
+    EXPECT_TRUE(p->done());
+    EXPECT_FALSE(p->yielded());
+    EXPECT_EQ(*p->returned_value(), 45 + 0x123456789ABCDEF + 10);
+}
+
+TEST_F(PromiseTest, pullWaitsForSuspendedGenerator) {
+    auto p = sum_pulled(suspending_range(3));
+    p->start();
+    EXPECT_FALSE(p->done());
+    point.resume();
+    EXPECT_EQ(*p->returned_value(), 3);
+}
+
+TEST_F(PromiseTest, pullRethrows) {
+    auto p = count_until_error();
+    p->start();
+    EXPECT_EQ(*p->returned_value(), 11);
+}
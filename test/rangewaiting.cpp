@@ -106,3 +106,23 @@ TEST_F(RangeSuspensionTest, range_promise_waiting) {
     expected_counts[PARALLEL_AWAIT_1]++;
     EXPECT_EQ(function_counts, expected_counts);
 }
+
+// The waiters of a range await once lived in lambda closures that were destroyed while they were suspended, resuming
+// them read freed memory. Other coroutines allocate in between, so that fails even without a sanitizer.
+TEST_F(RangeSuspensionTest, waitersOutliveAwaitExpression) {
+    auto p = range_promise_waiting();
+    p->start();
+    for (int i = 0; i < 64; i++) {
+        auto churn = [](int i) -> Promise<int> { co_return i; }(i);  // A capture would die with the closure
+        churn->start();
+    }
+    points[2].resume();
+    points[0].resume();
+    points[1].resume();
+    expected_counts[PARALLEL_AWAIT_0]++;
+    expected_counts[PARALLEL_PROMISE_0] += 3;
+    expected_counts[PARALLEL_PROMISE_1] += 3;
+    expected_counts[PARALLEL_AWAIT_1]++;
+    EXPECT_EQ(function_counts, expected_counts);
+    EXPECT_TRUE(p->done());
+}
@@ -0,0 +1,208 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "shard.h"
+#include "atomic_suspension_point.h"
+#include "task_group.h"
+// clang-format on
+
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = ::promise::Coroutine::living;
+
+class ShardTest : public testing::Test {
+   public:
+    ShardTest() { living.clear(); }
+    ~ShardTest() { EXPECT_TRUE(living.empty()); }
+
+    std::promise<size_t> answer;
+    std::promise<string> error;
+    vector<int> counts = vector<int>(3);
+
+    AtomicSuspensionPoint<void> remote_point;
+    Promise<void> wait_remote() {
+        co_await remote_point;
+        answer.set_value(this_shard().id());
+    }
+    Promise<void> ask(size_t target) {
+        answer.set_value(co_await shard(target).invoke([] { return this_shard().id(); }));
+    }
+    // Asks the next shard from the shard it runs on, so the call to target nests one more
+    Promise<size_t> relay(size_t target) {
+        co_return co_await shard(target).invoke([] { return this_shard().id() * 10; }) + this_shard().id();
+    }
+    Promise<void> ask_relay() {
+        answer.set_value(co_await shard(1).invoke([this] { return relay(2); }));
+    }
+    Promise<void> ask_failing() {
+        try {
+            co_await shard(1).invoke([]() -> int { throw runtime_error("failed on " + to_string(this_shard().id())); });
+        } catch (const runtime_error& e) {
+            error.set_value(e.what());
+        }
+    }
+    Promise<void> count_calls(int n) {
+        for (int i = 0; i < n; i++) {
+            co_await shard(1 + i % 2).invoke([this] { counts[this_shard().id()]++; });
+        }
+    }
+    vector<int> woken;
+    Promise<void> sleeper(int ms, size_t sleepers) {
+        co_await this_shard().sleep_for(chrono::milliseconds(ms));
+        woken.push_back(ms);
+        if (woken.size() == sleepers) answer.set_value(woken.size());
+    }
+    Promise<void> sleep_long() {
+        answer.set_value(this_shard().id());
+        co_await this_shard().sleep_for(chrono::minutes(1));
+    }
+    Promise<void> fan_out(int callers, int calls) {
+        TaskGroup group;
+        for (int i = 0; i < callers; i++) co_await group.spawn(count_calls(calls));
+        co_await group.join();
+        answer.set_value(callers * calls);
+    }
+};
+
+TEST_F(ShardTest, invokeRunsOnTarget) {
+    ShardRuntime runtime(2);
+    runtime.submit(0, [&] { this_shard().spawn(ask(1)); });
+    EXPECT_EQ(answer.get_future().get(), 1);
+}
+
+TEST_F(ShardTest, invokeOwnShard) {
+    ShardRuntime runtime(2);
+    runtime.submit(1, [&] { this_shard().spawn(ask(1)); });
+    EXPECT_EQ(answer.get_future().get(), 1);
+}
+
+TEST_F(ShardTest, promisesAreAwaitedOnTarget) {
+    ShardRuntime runtime(3);
+    runtime.submit(0, [&] { this_shard().spawn(ask_relay()); });
+    EXPECT_EQ(answer.get_future().get(), 21);
+}
+
+TEST_F(ShardTest, exceptionsTravelBack) {
+    ShardRuntime runtime(2);
+    runtime.submit(0, [&] { this_shard().spawn(ask_failing()); });
+    EXPECT_EQ(error.get_future().get(), "failed on 1");
+}
+
+// A resumption posted to the loop of a sleeping shard by another thread wakes it
+TEST_F(ShardTest, remoteResumeWakesShard) {
+    ShardRuntime runtime(2);
+    runtime.submit(1, [&] { this_shard().spawn(wait_remote()); });
+    this_thread::sleep_for(chrono::milliseconds(20));
+    remote_point.resume();
+    auto id = answer.get_future();
+    ASSERT_EQ(id.wait_for(chrono::seconds(2)), future_status::ready);
+    EXPECT_EQ(id.get(), 1);
+}
+
+// Queues of two entries overflow all the time, every call still arrives once
+TEST_F(ShardTest, fullQueuesKeepCalls) {
+    ShardRuntime runtime(3, 2);
+    runtime.submit(0, [&] { this_shard().spawn(fan_out(50, 100)); });
+    EXPECT_EQ(answer.get_future().get(), 5000);
+    EXPECT_EQ(counts, (vector<int>{0, 2500, 2500}));
+}
+
+TEST_F(ShardTest, threadsArePinned) {
+    ShardRuntime runtime(2);
+    runtime.submit(1, [&] { answer.set_value(this_shard().id()); });
+    EXPECT_EQ(answer.get_future().get(), 1);
+#ifdef __linux__
+    EXPECT_TRUE(runtime.at(1).pinned());
+#endif
+    ShardRuntime unpinned(1, 16, false);
+    EXPECT_FALSE(unpinned.at(0).pinned());
+}
+
+// The frame of a finished coroutine goes back to the pool of the shard and is taken by the next one
+TEST_F(ShardTest, framesAreReused) {
+    ShardRuntime runtime(1);
+    runtime.submit(0, [&] {
+        auto pool = detail::FramePool::local();
+        count_calls(0)->start();
+        size_t cached = pool->cached();
+        auto again = count_calls(0);
+        answer.set_value(cached - pool->cached());
+    });
+    EXPECT_EQ(answer.get_future().get(), 1);
+}
+
+// Sleeping shards wake up for their timers, which expire in the order of their deadlines
+TEST_F(ShardTest, sleepFor) {
+    ShardRuntime runtime(1);
+    auto start = chrono::steady_clock::now();
+    runtime.submit(0, [&] {
+        for (int ms : {30, 10, 20}) this_shard().spawn(sleeper(ms, 3));
+    });
+    EXPECT_EQ(answer.get_future().get(), 3);
+    EXPECT_GE(chrono::steady_clock::now() - start, chrono::milliseconds(30));
+    EXPECT_EQ(woken, (vector<int>{10, 20, 30}));
+}
+
+TEST_F(ShardTest, outsideOfShards) {
+    EXPECT_THROW(this_shard(), logic_error);
+    EXPECT_EQ(detail::FramePool::local(), nullptr);
+    ShardRuntime runtime(1);
+    auto sleep = runtime.at(0).sleep_for(chrono::milliseconds(1));
+    sleep->start();
+    EXPECT_TRUE(sleep->exception());
+}
+
+using detail::TimerWheel;
+
+Promise<void> wait_timer(TimerWheel& wheel, TimerWheel::Clock::time_point deadline, int& expired) {
+    TimerWheel::Timer timer(wheel, deadline);
+    co_await timer.point;
+    expired++;
+}
+
+// Timers more than a turn of the wheel away stay in their slot until their turn comes
+TEST_F(ShardTest, timerWheelTurns) {
+    auto start = TimerWheel::Clock::now();
+    TimerWheel wheel(chrono::milliseconds(1), 4, start);
+    int expired = 0;
+    auto far = wait_timer(wheel, start + chrono::milliseconds(10), expired);
+    auto near = wait_timer(wheel, start + chrono::microseconds(2500), expired);
+    far->start();
+    near->start();
+    EXPECT_EQ(wheel.next(), start + chrono::microseconds(2500));
+    EXPECT_EQ(wheel.expire(start + chrono::milliseconds(2)), 0);
+    EXPECT_EQ(wheel.expire(start + chrono::milliseconds(3)), 1);
+    EXPECT_EQ(wheel.next(), start + chrono::milliseconds(10));
+    EXPECT_EQ(wheel.expire(start + chrono::milliseconds(6)), 0);
+    EXPECT_EQ(wheel.expire(start + chrono::milliseconds(10)), 1);
+    EXPECT_EQ(expired, 2);
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_EQ(wheel.next(), TimerWheel::Clock::time_point::max());
+}
+
+// A sleeper whose Promise was dropped still wakes up, the ones that are left when the wheel goes away are destroyed
+TEST_F(ShardTest, timersOwnTheirSleepers) {
+    auto start = TimerWheel::Clock::now();
+    int expired = 0;
+    {
+        TimerWheel wheel(chrono::milliseconds(1), 4, start);
+        wait_timer(wheel, start + chrono::milliseconds(1), expired)->start();
+        wait_timer(wheel, start + chrono::milliseconds(9), expired)->start();
+        EXPECT_EQ(wheel.size(), 2);
+        EXPECT_EQ(wheel.expire(start + chrono::milliseconds(5)), 1);
+        EXPECT_EQ(wheel.size(), 1);
+    }
+    EXPECT_EQ(expired, 1);
+}
+
+TEST_F(ShardTest, sleepersAreDroppedWithTheShard) {
+    ShardRuntime runtime(1);
+    runtime.submit(0, [&] { this_shard().spawn(sleep_long()); });
+    EXPECT_EQ(answer.get_future().get(), 0);
+}
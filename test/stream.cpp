@@ -0,0 +1,124 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "stream.h"
+#include "event_loop.h"
+#include "thread_pool.h"
+// clang-format on
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class StreamTest : public testing::Test {
+   public:
+    StreamTest() { living.clear(); }
+    ~StreamTest() { EXPECT_TRUE(living.empty()); }
+
+    atomic<int> produced{};
+    atomic<bool> source_done{};
+    thread::id produced_on;
+
+    Promise<void, int> numbers(int n) {
+        struct Done {
+            atomic<bool>& done;
+            ~Done() { done = true; }
+        } done{source_done};
+        produced_on = this_thread::get_id();
+        for (int i = 0; i < n; i++) {
+            produced++;
+            co_yield i;
+        }
+    }
+    Promise<void, string> failing() {
+        co_yield "a";
+        co_yield "b";
+        throw runtime_error("source failed");
+    }
+
+    long long sum = 0;
+    int received = 0;
+    bool in_order = true;
+    Promise<void> add_all(Promise<void, int> values) {
+        while (auto value = co_await pull(values)) {
+            if (*value != received) in_order = false;
+            sum += *value;
+            received++;
+        }
+    }
+};
+
+// The producer runs on the pool, the consumer on the loop, every value arrives once and in order
+TEST_F(StreamTest, crossThread) {
+    constexpr int n = 100000;
+    ThreadPool pool(1);
+    EventLoop loop;
+    for (size_t batch : {1, 8}) {
+        sum = received = produced = 0;
+        source_done = false;
+        auto p = add_all(stream(numbers(n), pool, 16, batch));
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+        while (!source_done) this_thread::yield();
+        EXPECT_EQ(received, n);
+        EXPECT_TRUE(in_order);
+        EXPECT_EQ(sum, (long long) n * (n - 1) / 2);
+        EXPECT_NE(produced_on, this_thread::get_id());
+    }
+}
+
+// The producer fills the ring before anything is consumed, then waits for room
+TEST_F(StreamTest, producerStopsWhenFull) {
+    ThreadPool pool(1);
+    EventLoop loop;
+    auto values = stream(numbers(100), pool, 8);
+    while (produced < 9) this_thread::yield();  // 8 in the ring and one waiting for room
+    this_thread::sleep_for(chrono::milliseconds(10));
+    EXPECT_EQ(produced, 9);
+    auto p = add_all(std::move(values));
+    loop.spawn(p);
+    loop.run_until([&] { return p->done(); });
+    EXPECT_EQ(received, 100);
+    while (!source_done) this_thread::yield();
+}
+
+TEST_F(StreamTest, sourceException) {
+    ThreadPool pool(1);
+    EventLoop loop;
+    string seen;
+    bool caught = false;
+    auto consumer = [&](Promise<void, string> values) -> Promise<void> {
+        try {
+            while (auto value = co_await pull(values)) seen += *value;
+        } catch (const runtime_error&) {
+            caught = true;
+        }
+    };
+    auto p = consumer(stream(failing(), pool));
+    loop.spawn(p);
+    loop.run_until([&] { return p->done(); });
+    EXPECT_EQ(seen, "ab");
+    EXPECT_TRUE(caught);
+}
+
+// Dropping the consumer lets a producer that waits for room finish
+TEST_F(StreamTest, consumerStopsEarly) {
+    ThreadPool pool(1);
+    EventLoop loop;
+    auto consumer = [&](Promise<void, int> values) -> Promise<void> {
+        for (int i = 0; i < 3; i++) sum += *co_await pull(values);
+    };
+    {
+        auto p = consumer(stream(numbers(1000), pool, 4));
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+    }
+    while (!source_done) this_thread::yield();
+    EXPECT_EQ(sum, 3);
+    EXPECT_LT(produced, 1000);
+}
@@ -0,0 +1,113 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "task_group.h"
+#include "event_loop.h"
+// clang-format on
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class TaskGroupTest : public testing::Test {
+   public:
+    TaskGroupTest() { living.clear(); }
+    ~TaskGroupTest() { EXPECT_TRUE(living.empty()); }
+
+    vector<SuspensionPoint<void>> points{5};
+    vector<string> log;
+
+    Promise<void> child(int i) {
+        log.push_back("start " + to_string(i));
+        co_await points[i];
+        log.push_back("end " + to_string(i));
+    }
+    Promise<void> failing(int i) {
+        co_await points[i];
+        throw runtime_error("child " + to_string(i));
+    }
+    Promise<void> checking(TaskGroup& group, int i) {
+        co_await points[i];
+        log.push_back(group.cancelled() ? "cancelled" : "running");
+    }
+    Promise<void> fan_out(TaskGroup& group, int n) {
+        for (int i = 0; i < n; i++) co_await group.spawn(child(i));
+        log.push_back("spawned");
+        co_await group.join();
+        log.push_back("joined");
+    }
+    Promise<void> fail_fast(TaskGroup& group) {
+        co_await group.spawn(checking(group, 0));
+        co_await group.spawn(failing(1));
+        co_await group.spawn(child(2));
+        try {
+            co_await group.join();
+        } catch (const runtime_error& e) {
+            log.push_back(e.what());
+        }
+    }
+};
+
+TEST_F(TaskGroupTest, boundedConcurrency) {
+    TaskGroup group(2);
+    auto p = fan_out(group, 5);
+    p->start();
+    EXPECT_EQ(group.active(), 2);
+    EXPECT_EQ(group.waiting(), 1);
+    EXPECT_EQ(log, (vector<string>{"start 0", "start 1"}));
+    points[1].resume();
+    EXPECT_EQ(log.back(), "start 2");
+    EXPECT_EQ(group.active(), 2);
+    for (int i : {0, 2}) points[i].resume();
+    EXPECT_EQ(log.back(), "spawned");
+    points[3].resume();
+    EXPECT_FALSE(p->done());
+    points[4].resume();
+    EXPECT_EQ(log.back(), "joined");
+    EXPECT_TRUE(p->done());
+    EXPECT_EQ(group.peak(), 2);
+    EXPECT_EQ(group.active(), 0);
+}
+
+TEST_F(TaskGroupTest, errorCancelsSiblings) {
+    TaskGroup group(2);
+    auto p = fail_fast(group);
+    p->start();
+    EXPECT_EQ(group.waiting(), 1);
+    points[1].resume();
+    EXPECT_TRUE(group.cancelled());
+    EXPECT_EQ(group.waiting(), 0);
+    EXPECT_FALSE(p->done());
+    points[0].resume();
+    EXPECT_TRUE(p->done());
+    EXPECT_EQ(log, (vector<string>{"cancelled", "child 1"}));
+}
+
+TEST_F(TaskGroupTest, joinWithoutChildren) {
+    TaskGroup group;
+    auto p = fan_out(group, 0);
+    p->start();
+    EXPECT_EQ(log, (vector<string>{"spawned", "joined"}));
+}
+
+TEST_F(TaskGroupTest, childrenInheritExecutor) {
+    EventLoop loop;
+    TaskGroup group(2);
+    auto p = fan_out(group, 3);
+    loop.spawn(p);
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"start 0", "start 1"}));
+    points[0].resume();
+    EXPECT_EQ(loop.size(), 1);
+    loop.run();
+    EXPECT_EQ(log, (vector<string>{"start 0", "start 1", "end 0", "start 2", "spawned"}));
+    points[1].resume();
+    points[2].resume();
+    loop.run();
+    EXPECT_EQ(log.back(), "joined");
+    EXPECT_TRUE(p->done());
+}
@@ -0,0 +1,85 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "thread_pool.h"
+#include "event_loop.h"
+// clang-format on
+
+#include <atomic>
+#include <thread>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class ThreadPoolTest : public testing::Test {
+   public:
+    ThreadPoolTest() { living.clear(); }
+    ~ThreadPoolTest() { EXPECT_TRUE(living.empty()); }
+
+    atomic<int> count{};
+    Promise<void> increment() {
+        count++;
+        co_return;
+    }
+    thread::id ran_on;
+    Promise<void> record(SuspensionPoint<void>& point) {
+        co_await point;
+        ran_on = this_thread::get_id();
+    }
+    thread::id inner_on, middle_on, back_on;
+    Promise<void> inner(ThreadPool& pool, EventLoop& loop) {
+        co_await resume_on(pool);
+        inner_on = this_thread::get_id();
+        co_await resume_on(loop);
+    }
+    Promise<void> middle(ThreadPool& pool, EventLoop& loop) {
+        co_await inner(pool, loop);
+        middle_on = this_thread::get_id();
+        co_await resume_on(pool);
+        co_await resume_on(loop);
+        back_on = this_thread::get_id();
+    }
+    Promise<void> notify(SuspensionPoint<void>& point) {
+        point.resume();
+        co_return;
+    }
+};
+
+TEST_F(ThreadPoolTest, runsSpawnedCoroutines) {
+    {
+        ThreadPool pool(4);
+        EXPECT_EQ(pool.threads(), 4);
+        for (int i = 0; i < 1000; i++) pool.spawn(increment());
+        while (count < 1000) this_thread::yield();
+    }
+    EXPECT_EQ(count, 1000);
+}
+
+// A coroutine of an event loop that is woken by a pool thread continues on the thread of the loop
+TEST_F(ThreadPoolTest, remotePostToEventLoop) {
+    EventLoop loop;
+    SuspensionPoint<void> point;
+    auto p = record(point);
+    loop.spawn(p);
+    loop.run();
+    {
+        ThreadPool pool(1);
+        pool.spawn(notify(point));
+        loop.run_until([&] { return p->done(); });
+    }
+    EXPECT_EQ(ran_on, this_thread::get_id());
+}
+
+TEST_F(ThreadPoolTest, resumeOnMovesNestedChain) {
+    EventLoop loop;
+    {
+        ThreadPool pool(2);
+        auto p = middle(pool, loop);
+        loop.spawn(p);
+        loop.run_until([&] { return p->done(); });
+    }
+    EXPECT_NE(inner_on, this_thread::get_id());
+    EXPECT_EQ(middle_on, this_thread::get_id());
+    EXPECT_EQ(back_on, this_thread::get_id());
+}
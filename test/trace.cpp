@@ -0,0 +1,182 @@
+// clang-format off
+#include <gtest/gtest.h>
+#include "promise.h"
+#include "trace.h"
+// clang-format on
+
+#include <atomic>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace promise;
+using namespace std;
+
+static auto& living = promise::Coroutine::living;
+
+class TraceTest : public testing::Test {
+   public:
+    TraceTest() {
+        living.clear();
+        trace::clear();
+    }
+    ~TraceTest() { EXPECT_TRUE(living.empty()); }
+
+    SuspensionPoint<void> point;
+
+    Promise<void> suspending() { co_await point; }
+    Promise<void> awaiting() { co_await suspending(); }
+
+    static string json() {
+        ostringstream out;
+        trace::write_json(out);
+        return out.str();
+    }
+    static size_t count(const string& s, const string& part) {
+        size_t n = 0;
+        for (size_t i = s.find(part); i != string::npos; i = s.find(part, i + 1)) n++;
+        return n;
+    }
+};
+
+TEST_F(TraceTest, ringKeepsNewestEvents) {
+    trace::detail::Ring ring(1);
+    int x = 0;
+    for (size_t i = 0; i < trace::detail::Ring::capacity + 10; i++) ring.push({i, &x, nullptr, nullptr, trace::Kind::yielded});
+    auto events = ring.events();
+    ASSERT_EQ(events.size(), trace::detail::Ring::capacity);
+    EXPECT_EQ(events.front().time, 10);
+    EXPECT_EQ(events.back().time, trace::detail::Ring::capacity + 9);
+}
+
+// Exporting and clearing while the owner records gives whole events in order
+TEST_F(TraceTest, exportWhileRecording) {
+    trace::detail::Ring ring(1);
+    atomic<bool> stop = false;
+    thread writer([&] {
+        for (uint64_t i = 1; !stop; i++) ring.push({i, (const void*) i, nullptr, nullptr, trace::Kind::yielded});
+    });
+    for (int i = 0; i < 200; i++) {
+        auto events = ring.events();
+        EXPECT_LE(events.size(), trace::detail::Ring::capacity);
+        for (size_t j = 0; j < events.size(); j++) {
+            ASSERT_EQ(events[j].coroutine, (const void*) events[j].time);
+            if (j) {
+                ASSERT_EQ(events[j].time, events[j - 1].time + 1);
+            }
+        }
+        if (i % 10 == 0) ring.clear();
+    }
+    stop = true;
+    writer.join();
+}
+
+// The ring of a thread that exited is dropped once its events were exported
+TEST_F(TraceTest, finishedThreadsAreDropped) {
+    auto& registry = trace::detail::registry();
+    auto recorded = [] {
+        size_t n = 0;
+        for (auto& r : trace::events()) n += r.event.name && string(r.event.name) == "short lived";
+        return n;
+    };
+    trace::events();
+    size_t before = registry.rings().size();
+    int x = 0;
+    thread([&] { trace::detail::record(trace::Kind::created, &x, nullptr, "short lived"); }).join();
+    EXPECT_EQ(registry.rings().size(), before + 1);
+    EXPECT_EQ(recorded(), 1);
+    EXPECT_EQ(registry.rings().size(), before);
+    EXPECT_EQ(recorded(), 0);
+}
+
+// Without exports only the newest finished threads keep their rings
+TEST_F(TraceTest, finishedRingsAreCapped) {
+    int x = 0;
+    for (size_t i = 0; i < trace::detail::Registry::max_finished + 10; i++) {
+        thread([&] { trace::detail::record(trace::Kind::created, &x, nullptr, "churn"); }).join();
+    }
+    auto rings = trace::detail::registry().rings();
+    auto finished = count_if(rings.begin(), rings.end(), [](auto& ring) { return ring->finished.load(); });
+    EXPECT_EQ((size_t) finished, trace::detail::Registry::max_finished);
+    trace::events();
+}
+
+TEST_F(TraceTest, chromeEvents) {
+    int a = 0, b = 0;
+    trace::detail::record(trace::Kind::created, &a, nullptr, "outer");
+    trace::detail::record(trace::Kind::created, &b, nullptr, "inner \"quoted\"");
+    trace::detail::record(trace::Kind::awaited, &a, &b);
+    trace::detail::record(trace::Kind::suspended, &a, &b);
+    trace::detail::record(trace::Kind::done, &b);
+    trace::detail::record(trace::Kind::resumed, &a);
+    trace::detail::record(trace::Kind::stopped, &a);
+    trace::detail::record(trace::Kind::destroyed, &b);
+    trace::detail::record(trace::Kind::destroyed, &a);
+    auto s = json();
+    EXPECT_EQ(s.rfind("{\"traceEvents\":[", 0), 0);
+    EXPECT_EQ(count(s, "\"ph\":\"b\""), 3);
+    EXPECT_EQ(count(s, "\"ph\":\"e\""), 3);
+    EXPECT_EQ(count(s, "\"ph\":\"s\""), 1);
+    EXPECT_EQ(count(s, "\"ph\":\"f\""), 1);
+    EXPECT_EQ(count(s, "\"ph\":\"B\""), 1);
+    EXPECT_EQ(count(s, "\"ph\":\"E\""), 1);
+    EXPECT_EQ(count(s, "\"name\":\"outer\""), 4);
+    EXPECT_EQ(count(s, "\"name\":\"inner \\\"quoted\\\"\""), 2);
+}
+
+TEST_F(TraceTest, coroutineLifecycle) {
+    if (!trace::enabled) GTEST_SKIP() << "Trace points are only recorded with PROMISE_TRACE";
+    {
+        auto p = awaiting();
+        p->start();
+        point.resume();
+        EXPECT_TRUE(p->done());
+    }
+    auto s = json();
+    // Begin and end of the async track and of both runs
+    EXPECT_EQ(count(s, "TraceTest::awaiting"), 6);
+    EXPECT_EQ(count(s, "TraceTest::suspending"), 6);
+    EXPECT_EQ(count(s, "\"name\":\"woken\""), 1);
+    EXPECT_EQ(count(s, "\"name\":\"done\""), 2);
+    EXPECT_EQ(count(s, "\"ph\":\"s\""), 1);
+    EXPECT_EQ(count(s, "\"ph\":\"f\""), 1);
+    EXPECT_EQ(count(s, "\"ph\":\"b\""), count(s, "\"ph\":\"e\""));
+}
+
+// Flow arrows bind to the enclosing slice, so both ends of every arrow lie within a run of the thread
+TEST_F(TraceTest, flowsAreEnclosedBySlices) {
+    if (!trace::enabled) GTEST_SKIP() << "Trace points are only recorded with PROMISE_TRACE";
+    {
+        auto p = awaiting();
+        p->start();
+        point.resume();
+        EXPECT_TRUE(p->done());
+    }
+    auto s = json();
+    EXPECT_EQ(count(s, "\"ph\":\"B\""), 4);
+    EXPECT_EQ(count(s, "\"ph\":\"E\""), 4);
+
+    regex event("\"ph\":\"(.)\".*\"tid\":(\\d+),\"ts\":([0-9.]+)");
+    map<string, vector<double>> open;  // Begin times of the open slices of every thread
+    size_t flows = 0, enclosed = 0;
+    istringstream lines(s);
+    for (string line; getline(lines, line);) {
+        smatch m;
+        if (!regex_search(line, m, event)) continue;
+        auto ph = m[1].str(), tid = m[2].str();
+        if (ph == "B") open[tid].push_back(stod(m[3]));
+        if (ph == "E") {
+            ASSERT_FALSE(open[tid].empty());
+            open[tid].pop_back();
+        }
+        if (ph == "s" || ph == "f") {
+            flows++;
+            enclosed += !open[tid].empty() && open[tid].back() <= stod(m[3]);
+        }
+    }
+    EXPECT_EQ(flows, 2);
+    EXPECT_EQ(enclosed, 2);
+}